@@ -21,6 +21,7 @@
 
 #include "gerbv.h"
 #include "gerbvQt.h"
+#include "gerbvQtImageWriter.h"
 #include <iostream>
 #include <cairo.h>
 #include <QFlags>
@@ -82,13 +83,11 @@ int main(int argc, char** argv) {
 	//Draw it!
 	gqt.renderLayerToQt(&qtimage, mainProject->file[0], &RenderInfo);
 	
-	//Just to make sure - draw a background
-	QPainter painter(&qtimage);
-	painter.setCompositionMode(QPainter::CompositionMode_DestinationOver);
-	painter.fillRect(0, 0, size_x, size_y, gqt.backgroundColor());
+	//No need to draw a background: setInitFill and setFillFullDevice already did it.
+	//(Use gerbvQt::combineMono to combine several Format_Mono layers)
 	
 	//Save the image
-	qtimage.save("test.png");
+	gerbvQtImageWriter::write(qtimage, "test.png");
 	
 	//Draw the image using cairo
 	cairo_surface_t* surface = cairo_image_surface_create (CAIRO_FORMAT_ARGB32, size_x, size_y);
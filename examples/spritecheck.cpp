@@ -0,0 +1,98 @@
+/*
+
+    This file is part of gerbvQt.
+    (c) Kurganov Alexander, 2016 me@sx107.ru
+
+    gerbvQt is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    Foobar is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with gerbvQt.  If not, see <http://www.gnu.org/licenses/>.
+
+*/
+
+//Renders a layer with and without the flash sprites (gerbvQt::setFlashSprites)
+//and checks that the two Format_Mono images are the same bit for bit.
+
+#include "gerbv.h"
+#include "gerbvQt.h"
+#include "gerbvQtImageWriter.h"
+#include <iostream>
+#include <QtMath>
+
+//Pixels per unit: round ones (the flash phases repeat) and odd ones (they hardly ever do)
+const double scaleFactors[] = {1000.0, 25.4 / 0.01, 1200.0, 777.7, 3333.3};
+const double border = 10; //10 pixels border
+
+using namespace std;
+
+static void render(QImage& qtimage, gerbv_fileinfo_t* fileInfo, const gerbv_render_info_t* renderInfo, bool sprites) {
+	gerbvQt gqt;
+	gqt.setForegroundColor(Qt::color1);
+	gqt.setBackgroundColor(Qt::color0);
+	gqt.setDrawingMode(gerbvQt::dm_TwoColors);
+	gqt.setFillFullDevice(true);
+	gqt.setInitFill(true);
+	gqt.setRenderHints(QPainter::RenderHints(0));
+
+	//Everything else is drawn by QPainter in both images
+	gqt.setFixedPoint(false);
+	gqt.setAnalyticStrokes(false);
+	gqt.setFlashSprites(sprites);
+
+	gqt.renderLayerToQt(&qtimage, fileInfo, renderInfo);
+}
+
+int main(int argc, char** argv) {
+	if(argc < 2) {cerr << "Usage: ./gerbvQtspritecheck anygerberfile" << endl; return 1;}
+
+	gerbv_project_t *mainProject = gerbv_create_project();
+	gerbv_open_layer_from_filename (mainProject, argv[1]);
+	if(mainProject->file[0] == NULL) {cerr << "Can't open " << argv[1] << endl; return 1;}
+	gerbv_image_info_t* gInfo = mainProject->file[0]->image->info;
+
+	int failed = 0;
+	for(double scaleFactor : scaleFactors) {
+		int size_x = qCeil((gInfo->max_x - gInfo->min_x)*scaleFactor)+border*2;
+		int size_y = qCeil((gInfo->max_y - gInfo->min_y)*scaleFactor)+border*2;
+
+		gerbv_render_info_t RenderInfo;
+		RenderInfo.renderType = GERBV_RENDER_TYPE_CAIRO_HIGH_QUALITY;
+		RenderInfo.displayWidth = size_x;
+		RenderInfo.displayHeight = size_y;
+		RenderInfo.scaleFactorX = scaleFactor;
+		RenderInfo.scaleFactorY = scaleFactor;
+		RenderInfo.lowerLeftX = gInfo->min_x-border/scaleFactor;
+		RenderInfo.lowerLeftY = gInfo->min_y-border/scaleFactor;
+
+		QImage withSprites(size_x, size_y, QImage::Format_Mono);
+		QImage withQPainter(size_x, size_y, QImage::Format_Mono);
+		render(withSprites, mainProject->file[0], &RenderInfo, true);
+		render(withQPainter, mainProject->file[0], &RenderInfo, false);
+
+		QImage diff;
+		gerbvQt::monoDiff d = gerbvQt::diffMono(withSprites, withQPainter, &diff);
+		cout << "Scale " << scaleFactor << ": " << size_x << "x" << size_y << ", " << d.changedPixels << " pixels differ" << endl;
+		if(d.changedPixels != 0) {
+			//Keep the images of the first failure
+			if(failed == 0) {
+				gerbvQtImageWriter::write(withSprites, "sprites.png");
+				gerbvQtImageWriter::write(withQPainter, "qpainter.png");
+				gerbvQtImageWriter::write(diff, "diff.png");
+			}
+			failed++;
+		}
+	}
+
+	gerbv_destroy_project(mainProject);
+	if(failed) {cerr << failed << " scales differ, see sprites.png, qpainter.png and diff.png" << endl; return 1;}
+	cout << "The sprites are identical to QPainter" << endl;
+	return 0;
+}
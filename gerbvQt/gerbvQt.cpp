@@ -21,9 +21,14 @@
 
 
 #include "gerbvQt.h"
+#include "gerbvQtDisplayList.h"
+#include "gerbvQtStream.h"
 #include <iostream>
 #include <algorithm>
 #include <cmath>
+#include <thread>
+#include <vector>
+#include <memory>
 
 using namespace std;
 
@@ -33,13 +38,36 @@ gerbvQt::gerbvQt() {
 	color = Qt::black;
 	dM = gerbvQt::dm_CompositionModes;
 	painter = new QPainter;
+	maskPainter = new QPainter;
 	invertModes = false;
 	fullyFill = false;
 	startFill = true;
+	useSprites = true;
+	useAnalytic = false;
+	useFixed = false;
+	useAutoPlan = false;
+	userSettings = 0;
+	renderDepth = 0;
+	planTried = false;
+	autoRestore = false;
+	useMasks = false;
+	useReorder = false;
+	maskActive = false;
+	maskInverted = false;
+	ssFactor = 0;
+	macroPrecision = GERBVQT_MACRO_CIRCLE_PRECISION;
+	plan = renderPlan();
+	monoTarget = NULL;
+	spanImage = NULL;
+	spanBit = false;
+	spanByte = 0;
+	spanPixel = 0;
+	monoColorIndex = 0;
 }
 
 gerbvQt::~gerbvQt() {
 	delete painter;
+	delete maskPainter;
 }
 
 void gerbvQt::setMode(bool drawMode, QPainter* _painter) {
@@ -54,6 +82,12 @@ void gerbvQt::setMode(bool drawMode, QPainter* _painter) {
 			if(drawMode xor invertModes) {color = fgColor;}
 			else {color = bgColor;}
 			break;
+		case dm_AlphaMask:
+			//Full coverage, whatever the format is (alpha or gray)
+			if(drawMode xor invertModes) {_painter->setCompositionMode(QPainter::CompositionMode_Source);}
+			else {_painter->setCompositionMode(QPainter::CompositionMode_Clear);}
+			color = Qt::white;
+			break;
 	}
 	if(_painter->pen().color() != color) {
 		QPen q = _painter->pen();
@@ -84,6 +118,23 @@ void gerbvQt::setNetstateTransform(QTransform* tr, gerbv_netstate_t *state) {
 	}
 }
 
+void gerbvQt::parallelFor(int count, const std::function<void(int, int)>& job) {
+	int threads = qMax(1, int(std::thread::hardware_concurrency()));
+	threads = qMin(threads, count);
+	if(threads <= 1) {
+		if(count > 0) {job(0, count);}
+		return;
+	}
+	
+	//The calling thread takes the first chunk
+	std::vector<std::thread> workers;
+	for(int i = 1; i < threads; i++) {
+		workers.push_back(std::thread(job, int(qint64(count) * i / threads), int(qint64(count) * (i+1) / threads)));
+	}
+	job(0, count / threads);
+	for(size_t i = 0; i < workers.size(); i++) {workers[i].join();}
+}
+
 void gerbvQt::fillImage(const gerbv_image_t* gImage) {
 	if(fullyFill) {
 		painter->save();
@@ -111,20 +162,170 @@ void gerbvQt::renderImageToQt(	QPaintDevice * device,
 				gerbv_user_transformation_t utransform, 
 				const gerbv_render_info_t* renderInfo) {
 	
-	//Begin the painting
-	painter->begin(device);
+	gerbvQtImageNets nets(gImage);
+	beginRender();
+	renderNets(device, gImage, nets, utransform, renderInfo);
+	endRender();
+}
+
+void gerbvQt::renderDisplayListToQt(	QPaintDevice * device,
+					const gerbvQtDisplayList* displayList,
+					gerbv_user_transformation_t utransform,
+					const gerbv_render_info_t* renderInfo) {
 	
-	//RenderHints
-	painter->setRenderHints(~rhints, false);
-	painter->setRenderHints(rhints, true);
+	if(displayList->image() == NULL) {
+		cerr << "renderDisplayListToQt: the display list is empty." << endl;
+		return;
+	}
+	gerbvQtDisplayListNets nets(displayList);
+	beginRender();
+	renderNets(device, displayList->image(), nets, utransform, renderInfo);
+	endRender();
+}
+
+void gerbvQt::renderStreamToQt(	QPaintDevice * device,
+				gerbvQtStream* stream,
+				gerbv_user_transformation_t utransform,
+				const gerbv_render_info_t* renderInfo) {
 	
-	//Set default brush and pen
-	painter->setBrush(color);
-	painter->setPen(color);
+	//Waits for the first chunk, the header commands are parsed by then
+	const gerbv_image_t* gImage = stream->image();
+	if(gImage == NULL) {
+		cerr << "renderStreamToQt: the stream isn't open." << endl;
+		return;
+	}
 	
-	//Reset transform
-	painter->resetTransform();
-	painter->setViewTransformEnabled(true);
+	//The image box is known only at the end of the file
+	bool savedFullyFill = fullyFill;
+	fullyFill = true;
+	beginRender();
+	renderNets(device, gImage, *stream, utransform, renderInfo);
+	endRender();
+	fullyFill = savedFullyFill;
+}
+
+//A rendered board of renderPanelToQt
+struct gerbvQtPanelTile {
+	QTransform transform;
+	bool inverted;
+	QRect box;		//In the full picture coordinates
+	QImage image;
+};
+
+void gerbvQt::renderPanelToQt(	QPaintDevice * device,
+				const gerbv_image_t* gImage,
+				const QVector<gerbv_user_transformation_t>& placements,
+				const gerbv_render_info_t* renderInfo) {
+	
+	if(placements.isEmpty()) {return;}
+	
+	//The board is compiled only once
+	gerbvQtDisplayList displayList;
+	if(!displayList.compile(gImage)) {
+		cerr << "renderPanelToQt: can't compile the image." << endl;
+		return;
+	}
+	
+	bool savedFullyFill = fullyFill;
+	QPoint savedOrigin = origin;
+	
+	//Planned once for all the boards
+	beginRender();
+	gerbvQtDisplayListNets boardNets(&displayList);
+	autoPlan(QSize(device->width(), device->height()), planFormat(device), displayList.image(), boardNets, placements[0], renderInfo);
+	
+	//Filling the full device for every board would erase the others,
+	//so the device is filled once and then every board fills only its own box
+	if(startFill && fullyFill) {
+		gerbvQtNoNets noNets;
+		renderNets(device, displayList.image(), noNets, placements[0], renderInfo);
+		fullyFill = false;
+	}
+	
+	//A board can be copied as pixels only if its rendering doesn't depend on what is under it:
+	//an aliased QImage, and the initial fill of the board box, which must stay a rectangle on the device
+	QImage* target = (device->devType() == QInternal::Image) ? static_cast<QImage*>(device) : NULL;
+	bool canCopy = (target != NULL && startFill && !rhints.testFlag(QPainter::Antialiasing));
+	QRectF boardRect(QPointF(gImage->info->min_x, gImage->info->min_y), QPointF(gImage->info->max_x, gImage->info->max_y));
+	
+	QVector<gerbvQtPanelTile> tiles;
+	QVector<QRect> placed;
+	
+	for(int i = 0; i < placements.size(); i++) {
+		const gerbv_user_transformation_t& p = placements[i];
+		QTransform tr = imageTransform(gImage, p, renderInfo);
+		QRectF area = tr.mapRect(boardRect);
+		
+		QRect box;
+		int t = tiles.size();
+		bool axisAligned = (tr.type() <= QTransform::TxScale) || (fabs(tr.m11()) < 1e-12 && fabs(tr.m22()) < 1e-12);
+		if(canCopy && axisAligned) {
+			//The same board shifted by whole pixels is the same picture
+			for(t = 0; t < tiles.size(); t++) {
+				const QTransform& o = tiles[t].transform;
+				if(tiles[t].inverted != bool(p.inverted)) {continue;}
+				if(o.m11() != tr.m11() || o.m12() != tr.m12() || o.m21() != tr.m21() || o.m22() != tr.m22()) {continue;}
+				double sx = tr.dx() - o.dx();
+				double sy = tr.dy() - o.dy();
+				if(fabs(sx - qRound(sx)) > 1e-6 || fabs(sy - qRound(sy)) > 1e-6) {continue;}
+				box = tiles[t].box.translated(qRound(sx), qRound(sy));
+				break;
+			}
+			
+			//Pixels with the centers inside the box are filled
+			if(box.isEmpty()) {
+				box = QRect(QPoint(qRound(area.left()), qRound(area.top())), QPoint(qRound(area.right()) - 1, qRound(area.bottom()) - 1));
+			}
+			
+			//Overlapping boards have to be drawn over each other
+			for(int k = 0; k < placed.size() && !box.isEmpty(); k++) {
+				if(placed[k].intersects(box)) {box = QRect();}
+			}
+		}
+		
+		if(box.isEmpty()) {
+			renderDisplayListToQt(device, &displayList, p, renderInfo);
+		} else {
+			if(t == tiles.size()) {
+				gerbvQtPanelTile tile;
+				tile.transform = tr;
+				tile.inverted = p.inverted;
+				tile.box = box;
+				tile.image = QImage(box.size(), target->format());
+				if(target->depth() == 1) {tile.image.setColorTable(target->colorTable());}
+				tile.image.fill(0);
+				
+				//The whole tile is copied, so every pixel of it gets the initial fill (background,
+				//or foreground for inverted boards), not only the board box as fillImage maps it
+				bool boardFill = fullyFill;
+				fullyFill = true;
+				origin = box.topLeft();
+				renderDisplayListToQt(&tile.image, &displayList, p, renderInfo);
+				origin = savedOrigin;
+				fullyFill = boardFill;
+				tiles.append(tile);
+			}
+			
+			QPoint pos = box.topLeft() - savedOrigin;
+			if(target->depth() == 1) {
+				copyMono(*target, tiles[t].image, pos);
+			} else {
+				QPainter copyPainter(target);
+				copyPainter.setCompositionMode(QPainter::CompositionMode_Source);
+				copyPainter.drawImage(pos, tiles[t].image);
+				copyPainter.end();
+			}
+		}
+		placed.append(area.toAlignedRect());
+	}
+	
+	endRender();
+	fullyFill = savedFullyFill;
+}
+
+QTransform gerbvQt::imageTransform(	const gerbv_image_t* gImage,
+					const gerbv_user_transformation_t& utransform,
+					const gerbv_render_info_t* renderInfo) {
 	
 	//Create the transform matrix
 	QTransform globalTransform;
@@ -149,9 +350,57 @@ void gerbvQt::renderImageToQt(	QPaintDevice * device,
 	globalTransform.translate(gImage->info->offsetA, gImage->info->offsetB);
 	globalTransform.rotate(gImage->info->imageRotation);
 	
+	return globalTransform;
+}
+
+void gerbvQt::renderNets(	QPaintDevice * device,
+				const gerbv_image_t* gImage,
+				gerbvQtNetSource& nets,
+				gerbv_user_transformation_t utransform, 
+				const gerbv_render_info_t* renderInfo) {
+	
+	//Supersampled antialiasing renders the nets itself, in bands
+	if(nets.canRestart() && renderSupersampled(device, gImage, nets, utransform, renderInfo)) {return;}
+	
+	//Choose the settings for this image, unless the render has already been planned
+	autoPlan(QSize(device->width(), device->height()), planFormat(device), gImage, nets, utransform, renderInfo);
+	
+	//Draw every layer's nets grouped by the aperture and the position (see setReorderNets)
+	gerbvQtNetSource* source = &nets;
+	std::unique_ptr<gerbvQtSortedNets> sorted;
+	if(useReorder && nets.canReorder() && orderIndependent()) {
+		sorted.reset(new gerbvQtSortedNets(gImage, nets));
+		source = sorted.get();
+	}
+	
+	//Begin the painting
+	painter->begin(device);
+	prepareSpanTarget(device);
+	
+	//RenderHints
+	painter->setRenderHints(~rhints, false);
+	painter->setRenderHints(rhints, true);
+	
+	//Set default brush and pen
+	painter->setBrush(color);
+	painter->setPen(color);
+	
+	//Reset transform
+	painter->resetTransform();
+	painter->setViewTransformEnabled(true);
+	
+	//The device origin (when rendering a part of the picture) is kept in the view transform,
+	//so the world transform maps to the full picture whatever the origin is
+	painter->setWindow(QRect(origin, QSize(device->width(), device->height())));
+	painter->setViewport(QRect(0, 0, device->width(), device->height()));
+	
 	//Set the transform
+	QTransform globalTransform = imageTransform(gImage, utransform, renderInfo);
 	painter->setTransform(globalTransform);
 	
+	//Collect the layers of the same polarity in a mask?
+	bool masking = prepareMask(device);
+	
 	//Calculate the polarity
 	bool invertImage = utransform.inverted;
 	if (gImage->info->polarity == GERBV_POLARITY_NEGATIVE) {invertImage = !invertImage;}
@@ -179,7 +428,7 @@ void gerbvQt::renderImageToQt(	QPaintDevice * device,
 	QTransform stateTransform;
 	
 	//Main loop over all the nets
-	for (gerbv_net_t* cNet = gImage->netlist; cNet; cNet = gerbv_image_return_next_renderable_object(cNet)) {
+	for (const gerbv_net_t* cNet = source->first(); cNet; cNet = source->next()) {
 		//New layer
 		if(cNet->layer != oldLayer) {
 			//Apply all the transformations.
@@ -187,14 +436,17 @@ void gerbvQt::renderImageToQt(	QPaintDevice * device,
 			layerTransform.rotate(cNet->layer->rotation);
 			
 			//Set the transform.
-			painter->resetTransform();
 			painter->setTransform(globalTransform);
 			painter->setTransform(layerTransform, true);
 			
-			invertModes = ((cNet->layer->polarity == GERBV_POLARITY_CLEAR) xor invertImage);
+			bool layerInverted = ((cNet->layer->polarity == GERBV_POLARITY_CLEAR) xor invertImage);
+			gerbv_knockout_t *ko = &(cNet->layer->knockout);
+			
+			//A polarity change or a knockout ends the run of the mask
+			if(maskActive && (maskInverted != layerInverted || ko->firstInstance == TRUE)) {endMask();}
+			invertModes = maskActive ? false : layerInverted;
 			
 			//Draw the knockout area
-			gerbv_knockout_t *ko = &(cNet->layer->knockout);
 			if (ko->firstInstance == TRUE) {
 				setMode(ko->polarity != GERBV_POLARITY_CLEAR);
 				cout << "knockout: " << ko->width << " x " << ko->height << endl;
@@ -205,6 +457,7 @@ void gerbvQt::renderImageToQt(	QPaintDevice * device,
 								painter->brush());
 				
 			}
+			if(masking && !maskActive) {beginMask(layerInverted);}
 			
 			//Set the painter composition mode to darkMode
 			setMode(true);
@@ -216,7 +469,6 @@ void gerbvQt::renderImageToQt(	QPaintDevice * device,
 		//New state
 		if(cNet->state != oldState) {
 			setNetstateTransform(&stateTransform, cNet->state);
-			painter->resetTransform();
 			painter->setTransform(globalTransform);
 			painter->setTransform(layerTransform, true);
 			painter->setTransform(stateTransform, true);
@@ -238,19 +490,22 @@ void gerbvQt::renderImageToQt(	QPaintDevice * device,
 		gerbv_step_and_repeat_t *sr = &(cNet->layer->stepAndRepeat);
 		for(int iX = 0; iX < sr->X; iX++) {
 			for(int iY = 0; iY < sr->Y; iY++) {
-				painter->resetTransform();
 				painter->setTransform(temp, false);
 				painter->setTransform(QTransform::fromTranslate(iX * sr->dist_X, iY * sr->dist_Y), true);
+				if(fixedCulled(gImage, cNet)) {continue;}
 				if(polygonPath) {
-					painter->fillPath(*polygonPath, painter->brush());
+					fillPath(*polygonPath);
 				} else {
 					this->drawNet(gImage, cNet);
 				}
+				if(maskActive) {addMaskBounds(gImage, cNet, polygonPath);}
 			}
 		}
 		
 		if(polygonPath) {delete polygonPath;}
 	}
+	if(maskActive) {endMask();}
+	if(masking) {maskPainter->end();}
 	painter->end();
 }
 
@@ -305,6 +560,8 @@ void gerbvQt::drawNet(const gerbv_image_t* gImage, const gerbv_net_t* cNet) {
 void gerbvQt::drawLineCircle(QPointF& start, QPointF& stop, const gerbv_aperture_t* ap) {
 	//Parameters: diameter, hole diameter
 	//Ignore the "Hole diameter" parameter[1]
+	if(drawCapsule(start, stop, ap->parameter[0])) {return;}
+	
 	QPen pen;
 	pen.setColor(color);
 	pen.setWidthF(ap->parameter[0]);
@@ -328,6 +585,8 @@ void gerbvQt::drawLineRect(QPointF& start, QPointF& stop, const gerbv_aperture_t
 		QPointF(stop.x() + rectSize.x(), stop.y() + rectSize.y()),
 		QPointF(stop.x() + rectSize.x(), stop.y() - rectSize.y()),
 		QPointF(start.x() + rectSize.x(), start.y() - rectSize.y())};
+	if(drawConvexPolygon(points, 6)) {return;}
+	
 	painter->setPen(color);
 	painter->setBrush(color);
 	painter->drawPolygon(points, 6);
@@ -347,6 +606,8 @@ void gerbvQt::generateArcPath(QPainterPath& path, const gerbv_net_t* cNet) {
 }
 
 void gerbvQt::drawArcNet(const gerbv_net_t* cNet, const gerbv_aperture_t* ap) {
+	if(ap->type == GERBV_APTYPE_CIRCLE && drawArcCapsule(cNet, ap->parameter[0])) {return;}
+	
 	QPen pen;
 	pen.setColor(color);
 	pen.setWidthF(ap->parameter[0]);
@@ -392,18 +653,28 @@ void gerbvQt::drawNetFlash(const gerbv_net_t* cNet, const gerbv_aperture_t* ap)
 	}
 }
 
+void gerbvQt::generateCircleFlashPath(QPainterPath& path, const QPointF& point, const gerbv_aperture_t* ap) {
+	path.addEllipse(point, ap->parameter[0] / 2.0, ap->parameter[0] / 2.0); // Main aperture shape
+	path.addEllipse(point, ap->parameter[1] / 2.0, ap->parameter[1] / 2.0); // The hole
+}
+
 void gerbvQt::drawCircleFlash(const QPointF& point, const gerbv_aperture_t* ap) {
+	if(drawSpriteFlash(point, ap)) {return;}
 	QPainterPath f;
-	f.addEllipse(point, ap->parameter[0] / 2.0, ap->parameter[0] / 2.0); // Main aperture shape
-	f.addEllipse(point, ap->parameter[1] / 2.0, ap->parameter[1] / 2.0); // The hole
-	painter->fillPath(f, painter->brush());
+	generateCircleFlashPath(f, point, ap);
+	fillPath(f);
+}
+
+void gerbvQt::generateRectFlashPath(QPainterPath& path, const QPointF& point, const gerbv_aperture_t* ap) {
+	path.addRect(QRectF(point - QPointF(ap->parameter[0] / 2.0, ap->parameter[1] / 2.0), QSizeF(ap->parameter[0], ap->parameter[1])));
+	path.addEllipse(point, ap->parameter[2] / 2.0, ap->parameter[2] / 2.0);
 }
 
 void gerbvQt::drawRectFlash(const QPointF& point, const gerbv_aperture_t* ap) {
+	if(drawSpriteFlash(point, ap)) {return;}
 	QPainterPath f;
-	f.addRect(QRectF(point - QPointF(ap->parameter[0] / 2.0, ap->parameter[1] / 2.0), QSizeF(ap->parameter[0], ap->parameter[1])));
-	f.addEllipse(point, ap->parameter[2] / 2.0, ap->parameter[2] / 2.0);
-	painter->fillPath(f, painter->brush());
+	generateRectFlashPath(f, point, ap);
+	fillPath(f);
 }
 
 void gerbvQt::drawOblongFlash(const QPointF& point, const gerbv_aperture_t* ap) {
@@ -414,7 +685,7 @@ void gerbvQt::drawOblongFlash(const QPointF& point, const gerbv_aperture_t* ap)
 	
 	f.addRoundedRect(rect, rad, rad);
 	f.addEllipse(point, ap->parameter[2] / 2.0, ap->parameter[2] / 2.0);
-	painter->fillPath(f, painter->brush());
+	fillPath(f);
 }
 
 void gerbvQt::generatePolygonPath(QPainterPath& path, const QPointF& center, double radius, int numPoints, double angle, bool ccw, double angleTo) {
@@ -437,7 +708,7 @@ void gerbvQt::drawPolygonFlash(const QPointF& center, const gerbv_aperture_t* ap
 	QPainterPath f;
 	generatePolygonPath(f, center, ap->parameter[0] / 2.0, ap->parameter[1], ap->parameter[2]);
 	f.addEllipse(center, ap->parameter[3] / 2.0, ap->parameter[3] / 2.0);
-	painter->fillPath(f, painter->brush());
+	fillPath(f);
 }
 
 void gerbvQt::setMacroExposure(bool& var, double exposure) {
@@ -451,7 +722,8 @@ void gerbvQt::drawMacroFlash(const gerbv_net_t* cNet, const gerbv_aperture_t* ap
 	
 	//One solution creates a QPainterPath and uses the += and -= operators.
 	//But they turn bezier curves (used to draw circles) into a line, so circles start to look like
-	//heptagons. So, circles in this solution are drawn as polygons with GERBVQT_MACRO_CIRCLE_PRECISION sides.
+	//heptagons. So, circles in this solution are drawn as polygons with macroCirclePrecision() sides
+	//(GERBVQT_MACRO_CIRCLE_PRECISION by default).
 	
 	//The other solution is like the cairo_push_group function. A temporary QImage is created.
 	//The GERBVQT_MACRO_USE_TEMPIMAGE switches to this solution.
@@ -465,7 +737,7 @@ void gerbvQt::drawMacroFlash(const gerbv_net_t* cNet, const gerbv_aperture_t* ap
 	groupStorage.fill(QColor(0, 0, 0, 0));
 	QPainter groupPainter;
 	groupPainter.begin(&groupStorage);
-	groupPainter.setTransform(painter->transform());
+	groupPainter.setTransform(painter->combinedTransform());
 	groupPainter.setPen(painter->pen());
 	groupPainter.setBrush(painter->brush());
 	groupPainter.setTransform(QTransform::fromTranslate(cNet->stop_x, cNet->stop_y), true);
@@ -493,8 +765,8 @@ void gerbvQt::drawMacroFlash(const gerbv_net_t* cNet, const gerbv_aperture_t* ap
 				#ifdef GERBVQT_MACRO_USE_TEMPLATE
 				apShape.addEllipse(QPointF(par[CIRCLE_CENTER_X], par[CIRCLE_CENTER_Y]), rad, rad);
 				#else
-				//Draw circle as a GERBVQT_MACRO_CIRCLE_PRECISION polygon.
-				generatePolygonPath(apShape, QPointF(par[CIRCLE_CENTER_X], par[CIRCLE_CENTER_Y]), rad, GERBVQT_MACRO_CIRCLE_PRECISION, 0);
+				//Draw circle as a macroPrecision polygon.
+				generatePolygonPath(apShape, QPointF(par[CIRCLE_CENTER_X], par[CIRCLE_CENTER_Y]), rad, macroPrecision, 0);
 				#endif
 			}
 			break;
@@ -620,8 +892,8 @@ void gerbvQt::drawMacroFlash(const gerbv_net_t* cNet, const gerbv_aperture_t* ap
 					double outRadius = ringOuter - i*ringGap;
 					double inRadius = outRadius - ringThickness;
 					QPainterPath ring;
-					generatePolygonPath(ring, center, outRadius, GERBVQT_MACRO_CIRCLE_PRECISION, 0);
-					generatePolygonPath(ring, center, inRadius, GERBVQT_MACRO_CIRCLE_PRECISION, 0);
+					generatePolygonPath(ring, center, outRadius, macroPrecision, 0);
+					generatePolygonPath(ring, center, inRadius, macroPrecision, 0);
 					macroPath += ring;
 				}
 			#endif
@@ -637,7 +909,7 @@ void gerbvQt::drawMacroFlash(const gerbv_net_t* cNet, const gerbv_aperture_t* ap
 	#else
 	painter->save();
 	painter->setTransform(QTransform::fromTranslate(cNet->stop_x, cNet->stop_y), true);
-	painter->fillPath(macroPath, painter->brush());
+	fillPath(macroPath);
 	painter->restore();
 	#endif
 }
@@ -678,10 +950,10 @@ void gerbvQt::generateMacroThermalPath(QPainterPath& path, double* par) {
 		for(int i = 0; i < 4; i++) {
 			path.arcMoveTo(innerRect, ang_inner + i*90);
 			path.arcTo(outerRect, ang_outer + i*90, 0);
-			generatePolygonPath(path, center, r_outer, GERBVQT_MACRO_CIRCLE_PRECISION, ang_outer + i*90, true, (i+1)*90 - ang_outer);
+			generatePolygonPath(path, center, r_outer, macroPrecision, ang_outer + i*90, true, (i+1)*90 - ang_outer);
 			path.arcTo(outerRect, (i+1)*90 - ang_outer, 0);
 			path.arcTo(innerRect, (i+1)*90 - ang_inner, 0);
-			generatePolygonPath(path, center, r_inner, GERBVQT_MACRO_CIRCLE_PRECISION, (i+1)*90 - ang_inner, false, ang_inner + i*90);
+			generatePolygonPath(path, center, r_inner, macroPrecision, (i+1)*90 - ang_inner, false, ang_inner + i*90);
 			path.arcTo(innerRect, ang_inner + i*90, 0);
 			path.arcTo(outerRect, ang_outer + i*90, 0);
 			path.closeSubpath();
@@ -20,18 +20,95 @@
 
 
 #ifndef GERBVQT
+#define GERBVQT
 #include "gerbv.h"
 #include <QImage>
 #include <QPainter>
+#include <QHash>
+#include <QPair>
+#include <QVector>
+#include <functional>
+#include <vector>
 
 //See gerbvQt::drawMacroFlash(...)
 //#define GERBVQT_MACRO_USE_TEMPIMAGE 1
-#define GERBVQT_MACRO_CIRCLE_PRECISION 100
+#define GERBVQT_MACRO_CIRCLE_PRECISION 100	//Default of setMacroCirclePrecision
+
+//See gerbvQt::drawSpriteFlash(...)
+#define GERBVQT_SPRITE_PHASES 4096	//Sub-pixel phases cached per aperture
+#define GERBVQT_SPRITE_MAX_SIZE 128
+
+//See gerbvQt::setFixedPoint(...): subpixel bits of the fixed point device coordinates (24.8)
+#define GERBVQT_FIXED_SHIFT 8
+
+//See gerbvQt::renderCoverage(...)
+#define GERBVQT_COVERAGE_BAND_BYTES (32*1024*1024)
+
+//See gerbvQt::setReorderNets(...): cells per side of the grid the nets are sorted on
+#define GERBVQT_REORDER_GRID 256
+
+class gerbvQtDisplayList;
+class gerbvQtStream;
+
+//Sequential access to the renderable nets (see gerbvQt::renderNets)
+class gerbvQtNetSource {
+	public:
+		virtual ~gerbvQtNetSource() {}
+		
+		//Return the first/next renderable net, or NULL at the end.
+		//The next pointers of a GERBV_INTERPOLATION_PAREA_START net must lead
+		//through the polygon up to its GERBV_INTERPOLATION_PAREA_END net.
+		virtual const gerbv_net_t* first() = 0;
+		virtual const gerbv_net_t* next() = 0;
+		
+		//True if the returned nets stay valid until the end of the rendering,
+		//so they may be collected and drawn in another order (see gerbvQt::setReorderNets)
+		virtual bool canReorder() {return false;}
+		
+		//True if first() may be called again. The planner and the supersampling walk the nets more than once.
+		virtual bool canRestart() {return true;}
+};
+
+//Walks the netlist of a gerbv image
+class gerbvQtImageNets : public gerbvQtNetSource {
+	public:
+		gerbvQtImageNets(const gerbv_image_t* _gImage) : gImage(_gImage), cNet(NULL) {}
+		const gerbv_net_t* first() {cNet = gImage->netlist; return cNet;}
+		const gerbv_net_t* next() {
+			if(cNet) {cNet = gerbv_image_return_next_renderable_object(cNet);}
+			return cNet;
+		}
+		bool canReorder() {return true;}
+	private:
+		const gerbv_image_t* gImage;
+		gerbv_net_t* cNet;
+};
+
+//No nets at all, renders only the initial fill
+class gerbvQtNoNets : public gerbvQtNetSource {
+	public:
+		const gerbv_net_t* first() {return NULL;}
+		const gerbv_net_t* next() {return NULL;}
+};
+
+//The nets of a source that can be reordered, with every run of consecutive nets of the same layer
+//sorted by the netstate, the aperture and the Morton order of their position on a grid over the image
+class gerbvQtSortedNets : public gerbvQtNetSource {
+	public:
+		gerbvQtSortedNets(const gerbv_image_t* gImage, gerbvQtNetSource& source);
+		const gerbv_net_t* first() {index = 0; return next();}
+		const gerbv_net_t* next() {return (index < order.size()) ? order[index++] : NULL;}
+	private:
+		static quint32 mortonKey(quint32 x, quint32 y);
+		
+		std::vector<const gerbv_net_t*> order;
+		size_t index;
+};
 
 class gerbvQt {
 	public:
 		//See setDrawingMode
-		enum drawingModeType {dm_CompositionModes, dm_TwoColors};
+		enum drawingModeType {dm_CompositionModes, dm_TwoColors, dm_AlphaMask};
 		
 		gerbvQt();
 		virtual ~gerbvQt();
@@ -42,6 +119,29 @@ class gerbvQt {
 					gerbv_user_transformation_t utransform, 
 					const gerbv_render_info_t* renderInfo);
 		
+		//Renders a compiled display list (see gerbvQtDisplayList.h), no gerbv_image_t needed
+		void renderDisplayListToQt(	QPaintDevice * device,
+						const gerbvQtDisplayList* displayList,
+						gerbv_user_transformation_t utransform,
+						const gerbv_render_info_t* renderInfo);
+		
+		//Renders a file while it is being parsed (see gerbvQtStream.h), no gerbv_image_t needed.
+		//The image box isn't known in advance, so the initial fill covers the whole device.
+		void renderStreamToQt(	QPaintDevice * device,
+					gerbvQtStream* stream,
+					gerbv_user_transformation_t utransform,
+					const gerbv_render_info_t* renderInfo);
+		
+		//Renders the same image at many placements (a production panel).
+		//The image is compiled to a display list once. Placements that differ from an already rendered one
+		//only by whole device pixels are copied from it, the others replay the display list.
+		//Copying needs an aliased QImage device and the initial fill (see setInitFill); overlapping boards are always replayed.
+		//With setFillFullDevice the device is filled only once, then every board fills its own box.
+		void renderPanelToQt(	QPaintDevice * device,
+					const gerbv_image_t* gImage,
+					const QVector<gerbv_user_transformation_t>& placements,
+					const gerbv_render_info_t* renderInfo);
+		
 		// Renders a layer to the device
 		void renderLayerToQt(	QPaintDevice * device,
 					const gerbv_fileinfo_t *fileInfo,
@@ -63,11 +163,61 @@ class gerbvQt {
 		const QColor& foregroundColor(void) {return fgColor;}
 		const QColor& backgroundColor(void) {return bgColor;}
 		
+		//Copper coverage grid (see imageCoverage and renderCoverage)
+		struct coverageGrid {
+			int cellSize;			//Cell size in device pixels
+			int columns;
+			int rows;
+			QVector<double> density;	//Covered fraction (0..1) of every cell, row by row from the top
+		};
+		
+		//Computes the fraction of pixels with the given index in every cellSize x cellSize cell
+		//of a Format_Mono/Format_MonoLSB image. Cells on the right/bottom edges may be smaller.
+		static coverageGrid imageCoverage(const QImage& image, int cellSize, uint index = 1);
+		
+		//Renders the image in horizontal bands and computes its coverage grid.
+		//The full-size image is never allocated. Clear polarity layers and negative images are
+		//handled as usual, since the coverage is taken from the rendered bands.
+		coverageGrid renderCoverage(	const gerbv_image_t* gImage,
+						gerbv_user_transformation_t utransform,
+						const gerbv_render_info_t* renderInfo,
+						int cellSize);
+		
+		//Bitwise operations between 1bpp images (see combineMono)
+		enum monoOperation {mo_Invert, mo_Or, mo_And, mo_AndNot, mo_Xor};
+		
+		//dst = dst op src on the pixel indices of two Format_Mono/Format_MonoLSB images of the same size.
+		//mo_AndNot is dst & ~src, mo_Invert ignores src. Returns false if the images don't match.
+		//Use it to combine the layers, e.g. copper minus the soldermask openings.
+		static bool combineMono(QImage& dst, const QImage& src, monoOperation op);
+		
+		//Composites an 8-bit coverage mask (Format_Alpha8/Grayscale8, e.g. rendered in dm_AlphaMask mode) tinted with
+		//the color over dst at pos: SourceOver of the color with the coverage times the color's alpha.
+		//dst may be Format_Alpha8/Grayscale8/RGB32/ARGB32/ARGB32_Premultiplied. Returns false for the other formats.
+		//Use it to colorize and stack the layers rendered once as masks.
+		static bool compositeMask(QImage& dst, const QImage& mask, const QColor& color, const QPoint& pos = QPoint(0, 0));
+		
+		//Result of diffMono
+		struct monoDiff {
+			qint64 changedPixels;
+			QVector<QRect> regions;		//Bounding boxes of the connected groups of changed tiles
+		};
+		
+		//XORs two 1bpp images of the same size (e.g. two revisions of a layer) and counts the changed pixels.
+		//The changes are grouped by tileSize x tileSize tiles. If result isn't NULL, it receives the XOR image.
+		static monoDiff diffMono(const QImage& a, const QImage& b, QImage* result = NULL, int tileSize = 64);
+		
+		//Distance of the farthest point of a macro aperture (its simplified primitives) from its origin,
+		//or -1 if it has an unknown primitive
+		static double macroRadius(const gerbv_aperture_t* ap);
+		
 		//Sets the drawing mode.
 		//dm_CompositionModes uses SourceOver and Clear modes for foreground/background (inverse for negative)
 		//dm_TwoColors uses two colors - foreground and background
 		//Second mode is needed if you want to, for example, to draw on a Qt::Format_Mono QImage.
 		//(The Qt::Format_Mono QImage does NOT support composition modes)
+		//dm_AlphaMask renders the coverage into a Format_Alpha8/Grayscale8 QImage: 255 where it is dark, 0 where it is clear
+		//(Source and Clear modes, the colors are ignored). The mask is colorized later, see compositeMask.
 		void setDrawingMode(const drawingModeType& _dM) {dM = _dM;}
 		const drawingModeType& drawingMode(void) {return dM;}
 		
@@ -81,6 +231,122 @@ class gerbvQt {
 		void setFillFullDevice(bool _fullyFill) {fullyFill = _fullyFill;}
 		bool fillFullDevice(void) {return fullyFill;}
 		
+		//The pixel of the full renderInfo->displayWidth x displayHeight picture that
+		//corresponds to the top-left corner of the device. Allows rendering a part (band, tile) of it.
+		void setDeviceOrigin(const QPoint& _origin) {origin = _origin;}
+		const QPoint& deviceOrigin(void) {return origin;}
+		
+		//Stamp the circle and rectangle flashes from pre-rasterized bitmaps? On by default.
+		//A sprite is QPainter's own rasterization of the flash at the exact sub-pixel offset, so the output is the same
+		//as QPainter's (examples/spritecheck.cpp compares them). Only works in dm_TwoColors mode on a Format_Mono/Format_MonoLSB
+		//QImage without antialiasing and without setFixedPoint, otherwise the flashes are drawn with QPainter as usual.
+		void setFlashSprites(bool _useSprites) {useSprites = _useSprites; userSettings |= us_Sprites;}
+		bool flashSprites(void) {return useSprites;}
+		
+		//Scan-convert the tracks and arcs of circle apertures (and the tracks of rectangle apertures)
+		//analytically, straight into the QImage scanlines, instead of QPainter stroking?
+		//Works on Format_Mono/MonoLSB (dm_TwoColors), Format_Alpha8/Grayscale8 (dm_AlphaMask) and
+		//Format_RGB32/ARGB32/ARGB32_Premultiplied QImages without antialiasing, if the transform has no shear and the same scale on both axes.
+		//Off by default: the tracks of rectangle apertures are filled without the 1 pixel cosmetic outline QPainter draws
+		//around them, so a pixel on their edges may differ. The planner never turns them on by itself.
+		void setAnalyticStrokes(bool _useAnalytic) {useAnalytic = _useAnalytic; userSettings |= us_Analytic;}
+		bool analyticStrokes(void) {return useAnalytic;}
+		
+		//Quantize the coordinates once to a 1/256 pixel grid and scan-convert everything with integer math?
+		//The flashes, regions, macros, tracks and arcs are filled by an integer scanline rasterizer,
+		//and the nets outside of the device are culled by their integer bounding boxes.
+		//The output is the same whatever the device origin (tiling) is.
+		//Same device requirements as setAnalyticStrokes, otherwise QPainter is used as usual.
+		void setFixedPoint(bool _useFixed) {useFixed = _useFixed; userSettings |= us_Fixed;}
+		bool fixedPoint(void) {return useFixed;}
+		
+		//Number of sides of the polygons the macro circles are drawn with (see drawMacroFlash)
+		void setMacroCirclePrecision(int _macroPrecision) {macroPrecision = qMax(3, _macroPrecision); userSettings |= us_MacroPrecision;}
+		int macroCirclePrecision(void) {return macroPrecision;}
+		
+		//Collect every run of consecutive layers with the same polarity (%LPD/%LPC) into a 1bpp mask and
+		//apply it to the device with one set/clear pass over the drawn box, instead of switching the modes
+		//at every layer? A knockout ends the run. The output doesn't change.
+		//Same device requirements as setAnalyticStrokes (on Format_RGB32 only in dm_TwoColors mode).
+		void setPolarityMasks(bool _useMasks) {useMasks = _useMasks; userSettings |= us_Masks;}
+		bool polarityMasks(void) {return useMasks;}
+		
+		//Draw the nets of every layer grouped by the netstate and the aperture, in the Morton order of their
+		//positions on a GERBVQT_REORDER_GRID^2 grid over the image? It keeps the pen/brush/sprite state and
+		//the written memory together. The layers keep their order, so the polarities apply as usual.
+		//Only used without antialiasing and with opaque colors, where the order within a layer doesn't change
+		//any pixel, and only for gerbv images (display lists are drawn in the file order).
+		void setReorderNets(bool _useReorder) {useReorder = _useReorder; userSettings |= us_Reorder;}
+		bool reorderNets(void) {return useReorder;}
+		
+		//Statistics of an image on a device and the settings chosen for it (see planRender)
+		struct renderPlan {
+			//Statistics
+			int nets;			//Renderable nets (without the S&R copies)
+			int flashes;
+			int macroFlashes;
+			int tracks;			//Linear segments
+			int arcs;
+			int regions;
+			int regionVertices;
+			int apertures;			//Different apertures used
+			double apertureReuse;		//Average number of uses of an aperture
+			int stepRepeatCopies;		//Extra nets drawn by S&R
+			int layers;
+			int clearLayers;		//Layers with the clear polarity
+			int polarityRuns;		//Runs of consecutive layers with the same polarity
+			int apertureSwitches;		//Aperture changes between consecutive nets of a layer
+			double scale;			//Device pixels per image unit
+			double maxMacroCircle;		//Largest macro circle radius, device pixels
+			double visibleFraction;		//Part of the board box that is on the device
+			bool spanTarget;		//Spans can be written to the device (see setAnalyticStrokes)
+			
+			//Decisions
+			bool flashSprites;
+			bool analyticStrokes;
+			bool fixedPoint;
+			int macroCirclePrecision;
+			bool polarityMasks;
+			bool reorderNets;
+		};
+		
+		//Gathers the statistics of the image and chooses the fastest settings for it
+		//(device format, primitive mix, aperture reuse, S&R, board size vs. device size).
+		//Uses the current render hints, drawing mode and device origin. No setting is changed (see applyPlan),
+		//only lastPlan() returns the new plan.
+		renderPlan planRender(	const QPaintDevice * device,
+					const gerbv_image_t* gImage,
+					gerbv_user_transformation_t utransform,
+					const gerbv_render_info_t* renderInfo);
+		
+		//Applies all the decisions of a plan (setFlashSprites, setAnalyticStrokes, setFixedPoint, setMacroCirclePrecision,
+		//setPolarityMasks, setReorderNets), including the settings set explicitly before.
+		//A plan may be edited before applying it.
+		void applyPlan(const renderPlan& _plan);
+		
+		//Plan and apply the settings automatically before every render?
+		//The settings set explicitly with their setters override the plan: the automatic planning
+		//changes only the other ones (see resetExplicitSettings), and only for the render: they are
+		//restored when it returns. A render is planned once, for the device it draws into (the bands of
+		//renderSupersampled and renderCoverage, the full device otherwise), before any banding.
+		void setAutoPlan(bool _useAutoPlan) {useAutoPlan = _useAutoPlan;}
+		bool autoPlan(void) {return useAutoPlan;}
+		
+		//Lets the automatic planning choose all the settings again
+		void resetExplicitSettings(void) {userSettings = 0;}
+		
+		//The last plan made by planRender or by the automatic planning
+		const renderPlan& lastPlan(void) {return plan;}
+		
+		//Antialiasing by supersampling: the image is rendered aliased into 1bpp bands at n x n times
+		//the resolution and box-filtered down (n = 4 has a SWAR fast path). Adjacent shapes don't
+		//get the seams of QPainter's antialiasing. 0 or 1 turns it off, n is limited to 16.
+		//Works on Format_Alpha8/Grayscale8/RGB32/ARGB32/ARGB32_Premultiplied QImages: the foreground color
+		//(white in dm_AlphaMask mode) is composited with the coverage over the device (over the background, if setInitFill is on).
+		//The clear areas show the background, the other devices are drawn as usual.
+		void setSupersampling(int _ssFactor) {ssFactor = qBound(0, _ssFactor, 16);}
+		int supersampling(void) {return ssFactor;}
+		
 	private:
 		QColor fgColor;
 		QColor bgColor;
@@ -90,6 +356,60 @@ class gerbvQt {
 		
 		bool fullyFill;
 		bool startFill;
+		QPoint origin;
+		int macroPrecision;
+		
+		//Supersampling (see setSupersampling)
+		int ssFactor;
+		bool renderSupersampled(	QPaintDevice * device,
+						const gerbv_image_t* gImage,
+						gerbvQtNetSource& nets,
+						const gerbv_user_transformation_t& utransform,
+						const gerbv_render_info_t* renderInfo);
+		
+		//Planner (see planRender)
+		bool useAutoPlan;
+		renderPlan plan;
+		
+		//The settings set explicitly, the automatic planning leaves them alone
+		enum userSetting {us_Sprites = 1, us_Analytic = 2, us_Fixed = 4, us_MacroPrecision = 8, us_Masks = 16, us_Reorder = 32};
+		int userSettings;
+		void applyAutoPlan(const renderPlan& _plan);
+		
+		//Every public render is enclosed in beginRender/endRender, the outermost one plans (see autoPlan)
+		int renderDepth;
+		bool planTried;
+		bool autoRestore;
+		struct {
+			bool sprites, analytic, fixed, masks, reorder;
+			int macroPrecision;
+		} autoSaved;
+		void beginRender(void);
+		void endRender(void);
+		void autoPlan(	QSize deviceSize,
+				QImage::Format format,
+				const gerbv_image_t* gImage,
+				gerbvQtNetSource& nets,
+				const gerbv_user_transformation_t& utransform,
+				const gerbv_render_info_t* renderInfo);
+		
+		static QImage::Format planFormat(const QPaintDevice * device);
+		renderPlan planNets(	QSize deviceSize,
+					QImage::Format format,
+					const gerbv_image_t* gImage,
+					gerbvQtNetSource& nets,
+					const gerbv_user_transformation_t& utransform,
+					const gerbv_render_info_t* renderInfo);
+		
+		void renderNets(	QPaintDevice * device,
+					const gerbv_image_t* gImage,
+					gerbvQtNetSource& nets,
+					gerbv_user_transformation_t utransform,
+					const gerbv_render_info_t* renderInfo);
+		
+		static QTransform imageTransform(	const gerbv_image_t* gImage,
+							const gerbv_user_transformation_t& utransform,
+							const gerbv_render_info_t* renderInfo);
 		
 		void fillImage(const gerbv_image_t* gImage);
 		void setNetstateTransform(QTransform* tr, gerbv_netstate_t *state);
@@ -110,6 +430,99 @@ class gerbvQt {
 		void drawOblongFlash(const QPointF& point, const gerbv_aperture_t* ap);
 		void drawPolygonFlash(const QPointF& point, const gerbv_aperture_t* ap);
 		
+		void generateCircleFlashPath(QPainterPath& path, const QPointF& point, const gerbv_aperture_t* ap);
+		void generateRectFlashPath(QPainterPath& path, const QPointF& point, const gerbv_aperture_t* ap);
+		
+		//Sprites (see drawSpriteFlash)
+		struct spriteSet {
+			double scaleX;
+			double scaleY;
+			QHash<QPair<double, double>, QImage> sprites; //By the exact sub-pixel phase, null until the phase repeats
+		};
+		
+		bool useSprites;
+		bool useAnalytic;
+		QImage* monoTarget;		//The device, if it is a 1bpp QImage
+		QHash<const gerbv_aperture_t*, spriteSet> spriteCache;
+		QColor monoColor;		//Last color converted by monoIndex
+		uint monoColorIndex;
+		
+		void prepareSpanTarget(QPaintDevice* device);
+		uint monoIndex(const QColor& _color);
+		bool drawSpriteFlash(const QPointF& point, const gerbv_aperture_t* ap);
+		void stampMono(const QImage& mask, int dx, int dy, bool set);
+		static void copyMono(QImage& dst, const QImage& src, const QPoint& pos);
+		
+		//Spans (see spansReady)
+		QImage* spanImage;		//The device, if it is a QImage spans can be written to
+		bool spanBit;			//Bit value for the 1bpp devices
+		uchar spanByte;			//Coverage value for the 8bpp devices
+		quint32 spanPixel;		//Pixel value for the 32bpp devices
+		
+		bool spansReady(void);
+		void fillSpan(int y, int x0, int x1);
+		bool deviceScale(double& scale);
+		
+		//Analytic kernels (see setAnalyticStrokes)
+		bool drawCapsule(const QPointF& start, const QPointF& stop, double width);
+		bool drawConvexPolygon(const QPointF* points, int numPoints);
+		bool drawArcCapsule(const gerbv_net_t* cNet, double width);
+		void fillDisc(const QPointF& center, double radius);
+		
+		//Fixed point pipeline (see setFixedPoint)
+		struct fixedVertex {
+			qint64 x;
+			qint64 y;
+		};
+		struct fixedEdge {
+			qint64 x0, y0, x1, y1;		//y0 < y1
+			int dir;			//+1 if the edge goes down, -1 otherwise
+		};
+		
+		bool useFixed;
+		
+		bool toFixed(const QPointF& point, fixedVertex& v);
+		bool fixedCulled(const gerbv_image_t* gImage, const gerbv_net_t* cNet);
+		void fillPath(const QPainterPath& path);
+		bool fillPathFixed(const QPainterPath& path);
+		void fillFixedEdges(std::vector<fixedEdge>& edges, bool winding);
+		static void addFixedEdge(std::vector<fixedEdge>& edges, const fixedVertex& p, const fixedVertex& q);
+		static void flattenFixedCubic(std::vector<fixedEdge>& edges, const fixedVertex* p, int depth);
+		void fillFixedDisc(const fixedVertex& c, qint64 r);
+		bool fixedCapsule(const QPointF& start, const QPointF& stop, double radius);
+		bool fixedPolygon(const QPointF* points, int numPoints);
+		bool fixedArc(const QPointF& center, const QPointF* ends, double radius, double halfWidth, double sweep);
+		
+		//Polarity masks (see setPolarityMasks)
+		struct deviceState {
+			QPainter* painter;
+			drawingModeType mode;
+			QColor fg;
+			QColor bg;
+			QImage* monoTarget;
+			QImage* spanImage;
+		};
+		
+		bool useMasks;
+		QImage mask;			//Coverage of the current run, device sized, zero outside of the run
+		QPainter* maskPainter;
+		bool maskActive;
+		bool maskInverted;		//invertModes of the run's layers
+		QRect maskBox;			//Device pixels the run has drawn into the mask
+		deviceState deviceSaved;	//The device settings while the mask is painted
+		
+		bool prepareMask(QPaintDevice* device);
+		void beginMask(bool inverted);
+		void endMask(void);
+		void addMaskBounds(const gerbv_image_t* gImage, const gerbv_net_t* cNet, const QPainterPath* region);
+		
+		//Reordering (see setReorderNets)
+		bool useReorder;
+		bool orderIndependent(void);
+		
+		//Runs job(from, to) over [0, count) split between the hardware threads
+		static void parallelFor(int count, const std::function<void(int, int)>& job);
+		
 		
 		//Macro
 		void drawMacroFlash(const gerbv_net_t* cNet, const gerbv_aperture_t* ap);
@@ -120,7 +533,7 @@ class gerbvQt {
 		//Set fg/bg
 		void setMode(bool drawMode, QPainter* _painter = NULL);	//Sets the draw mode - true for "dark", false for "clear".
 									//It either works with the bg/fg colors in dm_TwoColors mode
-									//Or with the composition modes in dm_CompositionModes mode
+									//Or with the composition modes in dm_CompositionModes/dm_AlphaMask modes
 		bool invertModes;
 		
 		//Composition modes and colors
@@ -0,0 +1,421 @@
+/*
+
+    This file is part of gerbvQt.
+    (c) Kurganov Alexander, 2016 me@sx107.ru
+
+    gerbvQt is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    Foobar is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with gerbvQt.  If not, see <http://www.gnu.org/licenses/>.
+
+*/
+
+//Analysis of the rendered 1bpp images: copper coverage (density) grids, bitwise operations and diffs.
+
+#include "gerbvQt.h"
+#include <iostream>
+#include <cstring>
+#include <climits>
+#include <vector>
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define GERBVQT_HAVE_X86_DISPATCH
+#include <immintrin.h>
+#endif
+
+using namespace std;
+
+//Bit counting. The popcnt instruction is used when the CPU has it.
+static inline int popcount64(quint64 v) {
+	#if defined(__GNUC__)
+	return __builtin_popcountll(v);
+	#else
+	v = v - ((v >> 1) & 0x5555555555555555ULL);
+	v = (v & 0x3333333333333333ULL) + ((v >> 2) & 0x3333333333333333ULL);
+	v = (v + (v >> 4)) & 0x0F0F0F0F0F0F0F0FULL;
+	return int((v * 0x0101010101010101ULL) >> 56);
+	#endif
+}
+
+//Counts the set pixels in [x0, x1) of a 1bpp scanline
+template<bool lsb> static inline int countBitsT(const uchar* line, int x0, int x1) {
+	if(x0 >= x1) {return 0;}
+	int b0 = x0 >> 3;
+	int b1 = (x1 - 1) >> 3;
+
+	//Masks of the first and the last byte
+	uchar m0 = lsb ? uchar(0xFF << (x0 & 7)) : uchar(0xFF >> (x0 & 7));
+	uchar m1 = lsb ? uchar(0xFF >> (7 - ((x1 - 1) & 7))) : uchar(0xFF << (7 - ((x1 - 1) & 7)));
+	if(b0 == b1) {return popcount64(line[b0] & m0 & m1);}
+
+	int n = popcount64(line[b0] & m0) + popcount64(line[b1] & m1);
+
+	//Whole bytes in between, 8 at a time. The bit order does not matter here.
+	int i = b0 + 1;
+	for(; i + 8 <= b1; i += 8) {
+		quint64 w;
+		memcpy(&w, line + i, 8);
+		n += popcount64(w);
+	}
+	for(; i < b1; i++) {n += popcount64(line[i]);}
+	return n;
+}
+
+#ifdef GERBVQT_HAVE_X86_DISPATCH
+__attribute__((target("popcnt")))
+static void countCellRowPopcnt(const uchar* line, bool lsb, int width, int cellSize, quint64* counts) {
+	for(int x = 0, c = 0; x < width; x += cellSize, c++) {
+		counts[c] += lsb ? countBitsT<true>(line, x, qMin(width, x + cellSize)) : countBitsT<false>(line, x, qMin(width, x + cellSize));
+	}
+}
+#endif
+
+static void countCellRow(const uchar* line, bool lsb, int width, int cellSize, quint64* counts) {
+	#ifdef GERBVQT_HAVE_X86_DISPATCH
+	static const bool hasPopcnt = __builtin_cpu_supports("popcnt");
+	if(hasPopcnt) {countCellRowPopcnt(line, lsb, width, cellSize, counts); return;}
+	#endif
+	for(int x = 0, c = 0; x < width; x += cellSize, c++) {
+		counts[c] += lsb ? countBitsT<true>(line, x, qMin(width, x + cellSize)) : countBitsT<false>(line, x, qMin(width, x + cellSize));
+	}
+}
+
+gerbvQt::coverageGrid gerbvQt::imageCoverage(const QImage& image, int cellSize, uint index) {
+	coverageGrid grid;
+	grid.cellSize = qMax(1, cellSize);
+	grid.columns = (image.width() + grid.cellSize - 1) / grid.cellSize;
+	grid.rows = (image.height() + grid.cellSize - 1) / grid.cellSize;
+	grid.density.fill(0.0, grid.columns * grid.rows);
+
+	if(image.format() != QImage::Format_Mono && image.format() != QImage::Format_MonoLSB) {
+		cerr << "imageCoverage: only the Format_Mono and Format_MonoLSB images are supported." << endl;
+		return grid;
+	}
+	bool lsb = (image.format() == QImage::Format_MonoLSB);
+	int width = image.width();
+	int height = image.height();
+	int cs = grid.cellSize;
+	int columns = grid.columns;
+
+	//Rows of cells are counted in parallel
+	parallelFor(grid.rows, [&](int from, int to) {
+		QVector<quint64> counts(columns);
+		for(int r = from; r < to; r++) {
+			counts.fill(0);
+			int y0 = r * cs;
+			int y1 = qMin(height, y0 + cs);
+			for(int y = y0; y < y1; y++) {
+				countCellRow(image.constScanLine(y), lsb, width, cs, counts.data());
+			}
+			for(int c = 0; c < columns; c++) {
+				double area = double(qMin(width, (c+1) * cs) - c * cs) * double(y1 - y0);
+				double set = (index != 0) ? double(counts[c]) : area - double(counts[c]);
+				grid.density[r * columns + c] = set / area;
+			}
+		}
+	});
+
+	return grid;
+}
+
+gerbvQt::coverageGrid gerbvQt::renderCoverage(	const gerbv_image_t* gImage,
+						gerbv_user_transformation_t utransform,
+						const gerbv_render_info_t* renderInfo,
+						int cellSize) {
+	//The picture is rendered in bands of whole cell rows into a 1bpp image of at most
+	//GERBVQT_COVERAGE_BAND_BYTES, so the memory footprint does not depend on the picture size.
+	coverageGrid grid;
+	grid.cellSize = qMax(1, cellSize);
+	grid.columns = (renderInfo->displayWidth + grid.cellSize - 1) / grid.cellSize;
+	grid.rows = (renderInfo->displayHeight + grid.cellSize - 1) / grid.cellSize;
+	grid.density.fill(0.0, grid.columns * grid.rows);
+	if(grid.rows == 0 || grid.columns == 0) {return grid;}
+
+	//Store the settings
+	QColor oldFg = fgColor;
+	QColor oldBg = bgColor;
+	drawingModeType oldDM = dM;
+	bool oldStartFill = startFill;
+	bool oldFullyFill = fullyFill;
+	QPoint oldOrigin = origin;
+
+	//Copper is black (index 1), everything else is white (index 0)
+	fgColor = Qt::black;
+	bgColor = Qt::white;
+	dM = dm_TwoColors;
+	startFill = true;
+	fullyFill = true;
+
+	//Planned once for the bands of the whole picture
+	beginRender();
+	origin = QPoint(0, 0);
+	gerbvQtImageNets nets(gImage);
+	autoPlan(QSize(renderInfo->displayWidth, renderInfo->displayHeight), QImage::Format_Mono, gImage, nets, utransform, renderInfo);
+
+	qint64 bytesPerRow = (renderInfo->displayWidth + 31) / 32 * 4;
+	int cellRowsPerBand = qMax(qint64(1), qint64(GERBVQT_COVERAGE_BAND_BYTES) / (bytesPerRow * grid.cellSize));
+	int bandHeight = qMin(cellRowsPerBand * grid.cellSize, renderInfo->displayHeight);
+	QImage band(renderInfo->displayWidth, bandHeight, QImage::Format_Mono);
+	band.setColor(0, qRgb(255, 255, 255));
+	band.setColor(1, qRgb(0, 0, 0));
+
+	for(int r = 0; r < grid.rows; r += cellRowsPerBand) {
+		int y0 = r * grid.cellSize;
+		int h = qMin(bandHeight, renderInfo->displayHeight - y0);
+		if(h != band.height()) {
+			band = QImage(renderInfo->displayWidth, h, QImage::Format_Mono);
+			band.setColor(0, qRgb(255, 255, 255));
+			band.setColor(1, qRgb(0, 0, 0));
+		}
+
+		origin = QPoint(0, y0);
+		renderImageToQt(&band, gImage, utransform, renderInfo);
+
+		coverageGrid bandGrid = imageCoverage(band, grid.cellSize, 1);
+		for(int i = 0; i < bandGrid.density.size(); i++) {
+			grid.density[r * grid.columns + i] = bandGrid.density[i];
+		}
+	}
+
+	endRender();
+	
+	//Restore the settings
+	fgColor = oldFg;
+	bgColor = oldBg;
+	dM = oldDM;
+	startFill = oldStartFill;
+	fullyFill = oldFullyFill;
+	origin = oldOrigin;
+
+	return grid;
+}
+
+//Bitwise operations
+
+template<int op> static inline quint64 combineWord(quint64 d, quint64 s) {
+	switch(op) {
+		case gerbvQt::mo_Invert: return ~d;
+		case gerbvQt::mo_Or: return d | s;
+		case gerbvQt::mo_And: return d & s;
+		case gerbvQt::mo_AndNot: return d & ~s;
+		default: return d ^ s;
+	}
+}
+
+template<int op> static void combineRowT(uchar* dst, const uchar* src, int bytes) {
+	int i = 0;
+	for(; i + 8 <= bytes; i += 8) {
+		quint64 d, s;
+		memcpy(&d, dst + i, 8);
+		memcpy(&s, src + i, 8);
+		d = combineWord<op>(d, s);
+		memcpy(dst + i, &d, 8);
+	}
+	for(; i < bytes; i++) {dst[i] = uchar(combineWord<op>(dst[i], src[i]));}
+}
+
+#ifdef GERBVQT_HAVE_X86_DISPATCH
+template<int op> __attribute__((target("avx2"))) static void combineRowAvx2T(uchar* dst, const uchar* src, int bytes) {
+	const __m256i ones = _mm256_set1_epi32(-1);
+	int i = 0;
+	for(; i + 32 <= bytes; i += 32) {
+		__m256i d = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(dst + i));
+		__m256i s = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(src + i));
+		switch(op) {
+			case gerbvQt::mo_Invert: d = _mm256_xor_si256(d, ones); break;
+			case gerbvQt::mo_Or: d = _mm256_or_si256(d, s); break;
+			case gerbvQt::mo_And: d = _mm256_and_si256(d, s); break;
+			case gerbvQt::mo_AndNot: d = _mm256_andnot_si256(s, d); break;
+			default: d = _mm256_xor_si256(d, s); break;
+		}
+		_mm256_storeu_si256(reinterpret_cast<__m256i*>(dst + i), d);
+	}
+	combineRowT<op>(dst + i, src + i, bytes - i);
+}
+#endif
+
+typedef void (*combineRowFunc)(uchar*, const uchar*, int);
+
+static combineRowFunc combineRowFor(gerbvQt::monoOperation op) {
+	#ifdef GERBVQT_HAVE_X86_DISPATCH
+	static const bool hasAvx2 = __builtin_cpu_supports("avx2");
+	if(hasAvx2) {
+		switch(op) {
+			case gerbvQt::mo_Invert: return combineRowAvx2T<gerbvQt::mo_Invert>;
+			case gerbvQt::mo_Or: return combineRowAvx2T<gerbvQt::mo_Or>;
+			case gerbvQt::mo_And: return combineRowAvx2T<gerbvQt::mo_And>;
+			case gerbvQt::mo_AndNot: return combineRowAvx2T<gerbvQt::mo_AndNot>;
+			default: return combineRowAvx2T<gerbvQt::mo_Xor>;
+		}
+	}
+	#endif
+	switch(op) {
+		case gerbvQt::mo_Invert: return combineRowT<gerbvQt::mo_Invert>;
+		case gerbvQt::mo_Or: return combineRowT<gerbvQt::mo_Or>;
+		case gerbvQt::mo_And: return combineRowT<gerbvQt::mo_And>;
+		case gerbvQt::mo_AndNot: return combineRowT<gerbvQt::mo_AndNot>;
+		default: return combineRowT<gerbvQt::mo_Xor>;
+	}
+}
+
+static bool isMono(const QImage& image) {
+	return image.format() == QImage::Format_Mono || image.format() == QImage::Format_MonoLSB;
+}
+
+bool gerbvQt::combineMono(QImage& dst, const QImage& src, monoOperation op) {
+	if(!isMono(dst)) {
+		cerr << "combineMono: only the Format_Mono and Format_MonoLSB images are supported." << endl;
+		return false;
+	}
+
+	//mo_Invert only needs dst
+	QImage source;
+	if(op != mo_Invert) {
+		if(!isMono(src) || src.size() != dst.size()) {
+			cerr << "combineMono: the images must be 1bpp and of the same size." << endl;
+			return false;
+		}
+		source = (src.format() == dst.format()) ? src : src.convertToFormat(dst.format());
+	}
+
+	combineRowFunc combineRow = combineRowFor(op);
+	int bytes = (dst.width() + 7) / 8;
+	uchar* dstBits = dst.bits();
+	const uchar* srcBits = (op != mo_Invert) ? source.constBits() : dstBits;
+	int dstBpl = dst.bytesPerLine();
+	int srcBpl = (op != mo_Invert) ? source.bytesPerLine() : dstBpl;
+
+	parallelFor(dst.height(), [&](int from, int to) {
+		for(int y = from; y < to; y++) {
+			combineRow(dstBits + qint64(y) * dstBpl, srcBits + qint64(y) * srcBpl, bytes);
+		}
+	});
+	return true;
+}
+
+//Finds the first and the last set pixel in [x0, x1) of a 1bpp scanline, returns false if there is none
+static bool findSetRange(const uchar* line, int x0, int x1, bool lsb, int& first, int& last) {
+	first = -1;
+	for(int x = x0; x < x1; ) {
+		uchar b = line[x >> 3];
+		if(b == 0 && (x & 7) == 0) {x += 8; continue;}
+		int bit = x & 7;
+		if(lsb ? (b >> bit) & 1 : (b >> (7 - bit)) & 1) {first = x; break;}
+		x++;
+	}
+	if(first < 0) {return false;}
+	for(int x = x1 - 1; x >= first; ) {
+		uchar b = line[x >> 3];
+		if(b == 0 && (x & 7) == 7) {x -= 8; continue;}
+		int bit = x & 7;
+		if(lsb ? (b >> bit) & 1 : (b >> (7 - bit)) & 1) {last = x; break;}
+		x--;
+	}
+	return true;
+}
+
+gerbvQt::monoDiff gerbvQt::diffMono(const QImage& a, const QImage& b, QImage* result, int tileSize) {
+	monoDiff diff;
+	diff.changedPixels = 0;
+	if(!isMono(a) || !isMono(b) || a.size() != b.size()) {
+		cerr << "diffMono: the images must be 1bpp and of the same size." << endl;
+		return diff;
+	}
+
+	QImage other = (b.format() == a.format()) ? b : b.convertToFormat(a.format());
+	if(result) {*result = a.copy();}
+
+	bool lsb = (a.format() == QImage::Format_MonoLSB);
+	int width = a.width();
+	int height = a.height();
+	int bytes = (width + 7) / 8;
+	int ts = qMax(8, tileSize);
+	int tilesX = (width + ts - 1) / ts;
+	int tilesY = (height + ts - 1) / ts;
+	combineRowFunc xorRow = combineRowFor(mo_Xor);
+	uchar* resultBits = result ? result->bits() : NULL;
+	int resultBpl = result ? result->bytesPerLine() : 0;
+
+	//Per tile statistics
+	struct tileInfo {qint64 count; int x0, y0, x1, y1;};
+	std::vector<tileInfo> tiles(size_t(tilesX) * tilesY);
+	for(size_t i = 0; i < tiles.size(); i++) {tiles[i].count = 0; tiles[i].x0 = tiles[i].y0 = INT_MAX; tiles[i].x1 = tiles[i].y1 = -1;}
+
+	parallelFor(tilesY, [&](int from, int to) {
+		QVector<uchar> rowBuffer(bytes);
+		for(int ty = from; ty < to; ty++) {
+			int yEnd = qMin(height, (ty + 1) * ts);
+			for(int y = ty * ts; y < yEnd; y++) {
+				uchar* row = result ? resultBits + qint64(y) * resultBpl : rowBuffer.data();
+				if(!result) {memcpy(row, a.constScanLine(y), bytes);}
+				xorRow(row, other.constScanLine(y), bytes);
+
+				for(int tx = 0; tx < tilesX; tx++) {
+					int x0 = tx * ts;
+					int x1 = qMin(width, x0 + ts);
+					int n = lsb ? countBitsT<true>(row, x0, x1) : countBitsT<false>(row, x0, x1);
+					if(n == 0) {continue;}
+
+					tileInfo& t = tiles[size_t(ty) * tilesX + tx];
+					t.count += n;
+					int first, last;
+					findSetRange(row, x0, x1, lsb, first, last);
+					t.x0 = qMin(t.x0, first);
+					t.x1 = qMax(t.x1, last);
+					t.y0 = qMin(t.y0, y);
+					t.y1 = qMax(t.y1, y);
+				}
+			}
+		}
+	});
+
+	//Group the changed tiles (8-connected) with union-find
+	std::vector<int> parent(tiles.size());
+	for(size_t i = 0; i < parent.size(); i++) {parent[i] = int(i);}
+	auto findRoot = [&](int i) {
+		while(parent[i] != i) {parent[i] = parent[parent[i]]; i = parent[i];}
+		return i;
+	};
+
+	for(int ty = 0; ty < tilesY; ty++) {
+		for(int tx = 0; tx < tilesX; tx++) {
+			int i = ty * tilesX + tx;
+			if(tiles[i].count == 0) {continue;}
+			diff.changedPixels += tiles[i].count;
+
+			//Previous neighbours: left, top-left, top, top-right
+			const int nx[4] = {tx - 1, tx - 1, tx, tx + 1};
+			const int ny[4] = {ty, ty - 1, ty - 1, ty - 1};
+			for(int k = 0; k < 4; k++) {
+				if(nx[k] < 0 || nx[k] >= tilesX || ny[k] < 0) {continue;}
+				int j = ny[k] * tilesX + nx[k];
+				if(tiles[j].count == 0) {continue;}
+				parent[findRoot(i)] = findRoot(j);
+			}
+		}
+	}
+
+	QHash<int, int> regionOfRoot;
+	for(int i = 0; i < int(tiles.size()); i++) {
+		if(tiles[i].count == 0) {continue;}
+		QRect r(QPoint(tiles[i].x0, tiles[i].y0), QPoint(tiles[i].x1, tiles[i].y1));
+		int root = findRoot(i);
+		if(regionOfRoot.contains(root)) {
+			QRect& region = diff.regions[regionOfRoot.value(root)];
+			region = region.united(r);
+		} else {
+			regionOfRoot.insert(root, diff.regions.size());
+			diff.regions.append(r);
+		}
+	}
+
+	return diff;
+}
@@ -0,0 +1,532 @@
+/*
+
+    This file is part of gerbvQt.
+    (c) Kurganov Alexander, 2016 me@sx107.ru
+
+    gerbvQt is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    Foobar is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with gerbvQt.  If not, see <http://www.gnu.org/licenses/>.
+
+*/
+
+
+#include "gerbvQtDisplayList.h"
+#include <QCryptographicHash>
+#include <QSaveFile>
+#include <QDir>
+#include <QFileInfo>
+#include <QDateTime>
+#include <QHash>
+#include <iostream>
+#include <cstring>
+#include <cstddef>
+
+using namespace std;
+
+static const char dlMagic[8] = {'G', 'E', 'R', 'B', 'V', 'Q', 'D', 'L'};
+static const quint32 dlByteOrder = 0x01020304;
+
+gerbvQtDisplayList::gerbvQtDisplayList() {
+	data = NULL;
+	dataSize = 0;
+	mapped = NULL;
+	shell = NULL;
+}
+
+gerbvQtDisplayList::~gerbvQtDisplayList() {
+	clear();
+}
+
+void gerbvQtDisplayList::clear() {
+	delete shell;
+	shell = NULL;
+	apertures.clear();
+	primitives.clear();
+	layers.clear();
+	states.clear();
+
+	if(mapped) {
+		mapFile.unmap(mapped);
+		mapFile.close();
+		mapped = NULL;
+	}
+	storage.clear();
+	data = NULL;
+	dataSize = 0;
+}
+
+template<class T> static void appendSection(QByteArray& block, gerbvQtDisplayList::dlHeader& h, int s, const std::vector<T>& records) {
+	h.offset[s] = quint64(block.size());
+	h.count[s] = quint64(records.size());
+	if(!records.empty()) {block.append(reinterpret_cast<const char*>(&records[0]), int(records.size() * sizeof(T)));}
+}
+
+bool gerbvQtDisplayList::compile(const gerbv_image_t* gImage, const QByteArray& sourceHash, qint64 sourceSize, qint64 sourceTime) {
+	clear();
+	if(gImage == NULL || gImage->info == NULL) {return false;}
+
+	//Image info
+	std::vector<dlInfo> info(1);
+	memset(&info[0], 0, sizeof(dlInfo));
+	info[0].min_x = gImage->info->min_x;
+	info[0].min_y = gImage->info->min_y;
+	info[0].max_x = gImage->info->max_x;
+	info[0].max_y = gImage->info->max_y;
+	info[0].offsetA = gImage->info->offsetA;
+	info[0].offsetB = gImage->info->offsetB;
+	info[0].imageRotation = gImage->info->imageRotation;
+	info[0].imageJustifyOffsetActualA = gImage->info->imageJustifyOffsetActualA;
+	info[0].imageJustifyOffsetActualB = gImage->info->imageJustifyOffsetActualB;
+	info[0].polarity = gImage->info->polarity;
+	info[0].layertype = gImage->layertype;
+
+	//Apertures with their evaluated macros
+	std::vector<dlAperture> aps;
+	std::vector<dlPrimitive> prims;
+	for(int i = 0; i < APERTURE_MAX; i++) {
+		const gerbv_aperture_t* ap = gImage->aperture[i];
+		if(ap == NULL) {continue;}
+
+		dlAperture rec;
+		memset(&rec, 0, sizeof(rec));
+		rec.number = i;
+		rec.type = ap->type;
+		rec.unit = ap->unit;
+		rec.nufParameters = ap->nuf_parameters;
+		memcpy(rec.parameter, ap->parameter, sizeof(rec.parameter));
+		rec.firstPrimitive = int(prims.size());
+		for(const gerbv_simplified_amacro_t* mac = ap->simplified; mac != NULL; mac = mac->next) {
+			dlPrimitive p;
+			memset(&p, 0, sizeof(p));
+			p.type = mac->type;
+			memcpy(p.parameter, mac->parameter, sizeof(p.parameter));
+			prims.push_back(p);
+			rec.primitiveCount++;
+		}
+		aps.push_back(rec);
+	}
+
+	//Nets, layers, states
+	std::vector<dlLayer> lays;
+	std::vector<dlState> sts;
+	std::vector<dlCirseg> cirs;
+	std::vector<dlNet> nts;
+	QHash<const void*, int> layerIndex;
+	QHash<const void*, int> stateIndex;
+
+	auto appendNet = [&](const gerbv_net_t* cNet) {
+		dlNet rec;
+		memset(&rec, 0, sizeof(rec));
+		rec.start_x = cNet->start_x;
+		rec.start_y = cNet->start_y;
+		rec.stop_x = cNet->stop_x;
+		rec.stop_y = cNet->stop_y;
+		rec.bboxLeft = cNet->boundingBox.left;
+		rec.bboxRight = cNet->boundingBox.right;
+		rec.bboxBottom = cNet->boundingBox.bottom;
+		rec.bboxTop = cNet->boundingBox.top;
+		rec.aperture = cNet->aperture;
+		rec.apertureState = cNet->aperture_state;
+		rec.interpolation = cNet->interpolation;
+		rec.cirseg = -1;
+
+		if(!layerIndex.contains(cNet->layer)) {
+			const gerbv_layer_t* l = cNet->layer;
+			dlLayer lr;
+			memset(&lr, 0, sizeof(lr));
+			lr.rotation = l->rotation;
+			lr.polarity = l->polarity;
+			lr.srX = l->stepAndRepeat.X;
+			lr.srY = l->stepAndRepeat.Y;
+			lr.srDistX = l->stepAndRepeat.dist_X;
+			lr.srDistY = l->stepAndRepeat.dist_Y;
+			lr.koFirstInstance = l->knockout.firstInstance;
+			lr.koType = l->knockout.type;
+			lr.koPolarity = l->knockout.polarity;
+			lr.koLowerLeftX = l->knockout.lowerLeftX;
+			lr.koLowerLeftY = l->knockout.lowerLeftY;
+			lr.koWidth = l->knockout.width;
+			lr.koHeight = l->knockout.height;
+			lr.koBorder = l->knockout.border;
+			layerIndex.insert(l, int(lays.size()));
+			lays.push_back(lr);
+		}
+		rec.layer = layerIndex.value(cNet->layer);
+
+		if(!stateIndex.contains(cNet->state)) {
+			const gerbv_netstate_t* st = cNet->state;
+			dlState sr;
+			memset(&sr, 0, sizeof(sr));
+			sr.offsetA = st->offsetA;
+			sr.offsetB = st->offsetB;
+			sr.scaleA = st->scaleA;
+			sr.scaleB = st->scaleB;
+			sr.axisSelect = st->axisSelect;
+			sr.mirrorState = st->mirrorState;
+			sr.unit = st->unit;
+			stateIndex.insert(st, int(sts.size()));
+			sts.push_back(sr);
+		}
+		rec.state = stateIndex.value(cNet->state);
+
+		if(cNet->cirseg) {
+			dlCirseg c;
+			c.cp_x = cNet->cirseg->cp_x;
+			c.cp_y = cNet->cirseg->cp_y;
+			c.width = cNet->cirseg->width;
+			c.height = cNet->cirseg->height;
+			c.angle1 = cNet->cirseg->angle1;
+			c.angle2 = cNet->cirseg->angle2;
+			rec.cirseg = int(cirs.size());
+			cirs.push_back(c);
+		}
+		nts.push_back(rec);
+	};
+
+	for(gerbv_net_t* cNet = gImage->netlist; cNet; cNet = gerbv_image_return_next_renderable_object(cNet)) {
+		if(cNet->layer == NULL || cNet->state == NULL) {continue;}
+		appendNet(cNet);
+		if(cNet->interpolation != GERBV_INTERPOLATION_PAREA_START) {continue;}
+
+		//The polygon follows its PAREA_START net
+		size_t start = nts.size() - 1;
+		int vertexCount = 0;
+		for(gerbv_net_t* v = cNet->next; v != NULL; v = v->next) {
+			if(v->layer == NULL || v->state == NULL) {break;}
+			appendNet(v);
+			vertexCount++;
+			if(v->interpolation == GERBV_INTERPOLATION_PAREA_END) {break;}
+		}
+		nts[start].vertexCount = vertexCount;
+	}
+
+	//Put everything into one block
+	dlHeader h;
+	memset(&h, 0, sizeof(h));
+	memcpy(h.magic, dlMagic, sizeof(h.magic));
+	h.version = GERBVQT_DISPLAYLIST_VERSION;
+	h.byteOrder = dlByteOrder;
+	memcpy(h.sourceHash, sourceHash.constData(), qMin(int(sizeof(h.sourceHash)), sourceHash.size()));
+	h.sourceSize = quint64(sourceSize);
+	h.sourceTime = sourceTime;
+
+	storage = QByteArray(int(sizeof(dlHeader)), '\0');
+	appendSection(storage, h, dl_Info, info);
+	appendSection(storage, h, dl_Apertures, aps);
+	appendSection(storage, h, dl_Primitives, prims);
+	appendSection(storage, h, dl_Layers, lays);
+	appendSection(storage, h, dl_States, sts);
+	appendSection(storage, h, dl_Cirsegs, cirs);
+	appendSection(storage, h, dl_Nets, nts);
+	memcpy(storage.data(), &h, sizeof(h));
+
+	data = storage.constData();
+	dataSize = storage.size();
+	unpack();
+	return true;
+}
+
+bool gerbvQtDisplayList::save(const QString& fileName) const {
+	if(data == NULL) {return false;}
+	QSaveFile f(fileName);
+	if(!f.open(QFile::WriteOnly)) {
+		cerr << "Can't write the display list " << fileName.toLocal8Bit().constData() << endl;
+		return false;
+	}
+	if(f.write(data, dataSize) != dataSize) {
+		f.cancelWriting();
+		return false;
+	}
+	return f.commit();
+}
+
+bool gerbvQtDisplayList::load(const QString& fileName, const QByteArray& sourceHash) {
+	clear();
+	mapFile.setFileName(fileName);
+	if(!mapFile.open(QFile::ReadOnly)) {return false;}
+
+	qint64 size = mapFile.size();
+	mapped = mapFile.map(0, size);
+	if(mapped == NULL) {
+		mapFile.close();
+		return false;
+	}
+	data = reinterpret_cast<const char*>(mapped);
+	dataSize = size;
+
+	if(!validate(size, sourceHash)) {
+		clear();
+		return false;
+	}
+	unpack();
+	return true;
+}
+
+bool gerbvQtDisplayList::validate(qint64 size, const QByteArray& sourceHash) {
+	//A damaged or foreign cache file must never crash the renderer
+	if(size < qint64(sizeof(dlHeader))) {return false;}
+	const dlHeader* h = header();
+	if(memcmp(h->magic, dlMagic, sizeof(h->magic)) != 0) {return false;}
+	if(h->version != GERBVQT_DISPLAYLIST_VERSION || h->byteOrder != dlByteOrder) {return false;}
+	if(!sourceHash.isEmpty() && (sourceHash.size() != int(sizeof(h->sourceHash)) ||
+		memcmp(h->sourceHash, sourceHash.constData(), sizeof(h->sourceHash)) != 0)) {return false;}
+
+	const quint64 recordSize[dl_SectionCount] = {sizeof(dlInfo), sizeof(dlAperture), sizeof(dlPrimitive),
+						sizeof(dlLayer), sizeof(dlState), sizeof(dlCirseg), sizeof(dlNet)};
+	for(int s = 0; s < dl_SectionCount; s++) {
+		if(h->offset[s] % 8 != 0 || h->offset[s] > quint64(size)) {return false;}
+		if(h->count[s] > (quint64(size) - h->offset[s]) / recordSize[s]) {return false;}
+	}
+	if(h->count[dl_Info] != 1) {return false;}
+
+	const dlAperture* aps = section<dlAperture>(dl_Apertures);
+	for(quint64 i = 0; i < h->count[dl_Apertures]; i++) {
+		if(aps[i].number < 0 || aps[i].number >= APERTURE_MAX) {return false;}
+		if(aps[i].firstPrimitive < 0 || aps[i].primitiveCount < 0 ||
+			quint64(aps[i].firstPrimitive) + quint64(aps[i].primitiveCount) > h->count[dl_Primitives]) {return false;}
+		if(aps[i].nufParameters < 0 || aps[i].nufParameters > APERTURE_PARAMETERS_MAX) {return false;}
+	}
+
+	//The outline point count is a loop bound over the parameters
+	const dlPrimitive* prims = section<dlPrimitive>(dl_Primitives);
+	for(quint64 i = 0; i < h->count[dl_Primitives]; i++) {
+		if(prims[i].type != GERBV_APTYPE_MACRO_OUTLINE) {continue;}
+		double points = prims[i].parameter[OUTLINE_NUMBER_OF_POINTS];
+		if(!(points >= 0.0) || OUTLINE_ROTATION + 2*points >= APERTURE_PARAMETERS_MAX) {return false;}
+	}
+
+	const dlNet* n = nets();
+	quint64 netCount = h->count[dl_Nets];
+	for(quint64 i = 0; i < netCount; i++) {
+		if(n[i].layer < 0 || quint64(n[i].layer) >= h->count[dl_Layers]) {return false;}
+		if(n[i].state < 0 || quint64(n[i].state) >= h->count[dl_States]) {return false;}
+		if(n[i].cirseg < -1 || (n[i].cirseg >= 0 && quint64(n[i].cirseg) >= h->count[dl_Cirsegs])) {return false;}
+		if(n[i].vertexCount < 0 || quint64(n[i].vertexCount) >= netCount - i) {return false;}
+		//The renderer indexes gerbv_image_t::aperture with it
+		if(n[i].aperture < 0 || n[i].aperture >= APERTURE_MAX) {return false;}
+		if(n[i].apertureState < GERBV_APERTURE_STATE_OFF || n[i].apertureState > GERBV_APERTURE_STATE_FLASH) {return false;}
+		if(n[i].interpolation < GERBV_INTERPOLATION_LINEARx1 || n[i].interpolation > GERBV_INTERPOLATION_DELETED) {return false;}
+	}
+	return true;
+}
+
+void gerbvQtDisplayList::unpack() {
+	const dlHeader* h = header();
+
+	shell = new gerbv_image_t;
+	memset(shell, 0, sizeof(gerbv_image_t));
+	memset(&shellInfo, 0, sizeof(shellInfo));
+	const dlInfo* info = section<dlInfo>(dl_Info);
+	shellInfo.min_x = info->min_x;
+	shellInfo.min_y = info->min_y;
+	shellInfo.max_x = info->max_x;
+	shellInfo.max_y = info->max_y;
+	shellInfo.offsetA = info->offsetA;
+	shellInfo.offsetB = info->offsetB;
+	shellInfo.imageRotation = info->imageRotation;
+	shellInfo.imageJustifyOffsetActualA = info->imageJustifyOffsetActualA;
+	shellInfo.imageJustifyOffsetActualB = info->imageJustifyOffsetActualB;
+	shellInfo.polarity = gerbv_polarity_t(info->polarity);
+	shell->layertype = gerbv_layertype_t(info->layertype);
+	shell->info = &shellInfo;
+
+	//Macro primitives, linked by apertures below
+	const dlPrimitive* prims = section<dlPrimitive>(dl_Primitives);
+	primitives.resize(h->count[dl_Primitives]);
+	for(size_t i = 0; i < primitives.size(); i++) {
+		memset(&primitives[i], 0, sizeof(gerbv_simplified_amacro_t));
+		primitives[i].type = gerbv_aperture_type_t(prims[i].type);
+		memcpy(primitives[i].parameter, prims[i].parameter, sizeof(prims[i].parameter));
+	}
+
+	const dlAperture* aps = section<dlAperture>(dl_Apertures);
+	apertures.resize(h->count[dl_Apertures]);
+	for(size_t i = 0; i < apertures.size(); i++) {
+		gerbv_aperture_t& ap = apertures[i];
+		memset(&ap, 0, sizeof(gerbv_aperture_t));
+		ap.type = gerbv_aperture_type_t(aps[i].type);
+		ap.unit = gerbv_unit_t(aps[i].unit);
+		ap.nuf_parameters = aps[i].nufParameters;
+		memcpy(ap.parameter, aps[i].parameter, sizeof(ap.parameter));
+		if(aps[i].primitiveCount > 0) {
+			for(int p = 0; p < aps[i].primitiveCount - 1; p++) {
+				primitives[aps[i].firstPrimitive + p].next = &primitives[aps[i].firstPrimitive + p + 1];
+			}
+			ap.simplified = &primitives[aps[i].firstPrimitive];
+		}
+		shell->aperture[aps[i].number] = &ap;
+	}
+
+	const dlLayer* lays = section<dlLayer>(dl_Layers);
+	layers.resize(h->count[dl_Layers]);
+	for(size_t i = 0; i < layers.size(); i++) {
+		gerbv_layer_t& l = layers[i];
+		memset(&l, 0, sizeof(gerbv_layer_t));
+		l.rotation = lays[i].rotation;
+		l.polarity = gerbv_polarity_t(lays[i].polarity);
+		l.stepAndRepeat.X = lays[i].srX;
+		l.stepAndRepeat.Y = lays[i].srY;
+		l.stepAndRepeat.dist_X = lays[i].srDistX;
+		l.stepAndRepeat.dist_Y = lays[i].srDistY;
+		l.knockout.firstInstance = lays[i].koFirstInstance;
+		l.knockout.type = gerbv_knockout_type_t(lays[i].koType);
+		l.knockout.polarity = gerbv_polarity_t(lays[i].koPolarity);
+		l.knockout.lowerLeftX = lays[i].koLowerLeftX;
+		l.knockout.lowerLeftY = lays[i].koLowerLeftY;
+		l.knockout.width = lays[i].koWidth;
+		l.knockout.height = lays[i].koHeight;
+		l.knockout.border = lays[i].koBorder;
+	}
+
+	const dlState* sts = section<dlState>(dl_States);
+	states.resize(h->count[dl_States]);
+	for(size_t i = 0; i < states.size(); i++) {
+		gerbv_netstate_t& st = states[i];
+		memset(&st, 0, sizeof(gerbv_netstate_t));
+		st.offsetA = sts[i].offsetA;
+		st.offsetB = sts[i].offsetB;
+		st.scaleA = sts[i].scaleA;
+		st.scaleB = sts[i].scaleB;
+		st.axisSelect = gerbv_axis_select_t(sts[i].axisSelect);
+		st.mirrorState = gerbv_mirror_state_t(sts[i].mirrorState);
+		st.unit = gerbv_unit_t(sts[i].unit);
+	}
+}
+
+bool gerbvQtDisplayList::openCached(const QString& sourceFile, const QString& cacheDir) {
+	QFileInfo source(sourceFile);
+	if(!source.isFile()) {
+		cerr << "Can't read " << sourceFile.toLocal8Bit().constData() << endl;
+		return false;
+	}
+	qint64 size = source.size();
+	qint64 time = source.lastModified().toMSecsSinceEpoch();
+	QString cached = cacheFileName(cacheDir, sourceFile);
+
+	//The same size and time: the cache is up to date, the source isn't read at all
+	QByteArray hash;
+	if(QFile::exists(cached) && load(cached)) {
+		const dlHeader* h = header();
+		if(h->sourceSize == quint64(size) && h->sourceTime == time) {return true;}
+
+		//Touched or copied: the contents decide
+		hash = hashFile(sourceFile);
+		bool same = (hash.size() == int(sizeof(h->sourceHash)) && memcmp(h->sourceHash, hash.constData(), sizeof(h->sourceHash)) == 0);
+		clear();
+		if(same) {
+			if(!stampSource(cached, size, time)) {cerr << "Can't update the display list cache " << cached.toLocal8Bit().constData() << endl;}
+			if(load(cached, hash)) {return true;}
+		}
+	}
+
+	if(hash.isEmpty()) {hash = hashFile(sourceFile);}
+	if(hash.isEmpty()) {
+		cerr << "Can't read " << sourceFile.toLocal8Bit().constData() << endl;
+		return false;
+	}
+
+	//Cache miss: parse the file with libgerbv
+	gerbv_project_t* project = gerbv_create_project();
+	QByteArray localName = sourceFile.toLocal8Bit();
+	gerbv_open_layer_from_filename(project, localName.data());
+	bool ok = false;
+	if(project->file[0] && project->file[0]->image) {
+		ok = compile(project->file[0]->image, hash, size, time);
+	}
+	gerbv_destroy_project(project);
+
+	if(ok) {
+		QDir().mkpath(cacheDir);
+		if(!save(cached)) {cerr << "Can't save the display list cache " << cached.toLocal8Bit().constData() << endl;}
+	}
+	return ok;
+}
+
+bool gerbvQtDisplayList::stampSource(const QString& fileName, qint64 sourceSize, qint64 sourceTime) {
+	//Rewrites the size and the time of the source in a saved display list
+	QFile f(fileName);
+	if(!f.open(QFile::ReadWrite) || !f.seek(offsetof(dlHeader, sourceSize))) {return false;}
+	quint64 stamp[2] = {quint64(sourceSize), quint64(sourceTime)};
+	return f.write(reinterpret_cast<const char*>(stamp), sizeof(stamp)) == qint64(sizeof(stamp));
+}
+
+QByteArray gerbvQtDisplayList::hashFile(const QString& fileName) {
+	QFile f(fileName);
+	if(!f.open(QFile::ReadOnly)) {return QByteArray();}
+	QCryptographicHash hash(QCryptographicHash::Md5);
+	if(!hash.addData(&f)) {return QByteArray();}
+	return hash.result();
+}
+
+QString gerbvQtDisplayList::cacheFileName(const QString& cacheDir, const QString& sourceFile) {
+	//The same file under another name gets the same cache
+	QFileInfo source(sourceFile);
+	QString path = source.canonicalFilePath();
+	if(path.isEmpty()) {path = source.absoluteFilePath();}
+	QByteArray key = QCryptographicHash::hash(path.toUtf8(), QCryptographicHash::Md5);
+	return QDir(cacheDir).filePath(QString::fromLatin1(key.toHex()) + ".gqdl");
+}
+
+//gerbvQtDisplayListNets
+
+const gerbv_net_t* gerbvQtDisplayListNets::next() {
+	if(index < dl->netCount()) {index += 1 + dl->nets()[index].vertexCount;}
+	return unpack();
+}
+
+void gerbvQtDisplayListNets::unpackNet(gerbv_net_t& n, gerbv_cirseg_t& c, const gerbvQtDisplayList::dlNet& rec) {
+	n.start_x = rec.start_x;
+	n.start_y = rec.start_y;
+	n.stop_x = rec.stop_x;
+	n.stop_y = rec.stop_y;
+	n.boundingBox.left = rec.bboxLeft;
+	n.boundingBox.right = rec.bboxRight;
+	n.boundingBox.bottom = rec.bboxBottom;
+	n.boundingBox.top = rec.bboxTop;
+	n.aperture = rec.aperture;
+	n.aperture_state = gerbv_aperture_state_t(rec.apertureState);
+	n.interpolation = gerbv_interpolation_t(rec.interpolation);
+	n.cirseg = NULL;
+	if(rec.cirseg >= 0) {
+		const gerbvQtDisplayList::dlCirseg& cs = dl->cirsegs()[rec.cirseg];
+		c.cp_x = cs.cp_x;
+		c.cp_y = cs.cp_y;
+		c.width = cs.width;
+		c.height = cs.height;
+		c.angle1 = cs.angle1;
+		c.angle2 = cs.angle2;
+		n.cirseg = &c;
+	}
+	n.next = NULL;
+	n.label = NULL;
+	n.layer = dl->layer(rec.layer);
+	n.state = dl->state(rec.state);
+}
+
+const gerbv_net_t* gerbvQtDisplayListNets::unpack() {
+	if(index >= dl->netCount()) {return NULL;}
+	const gerbvQtDisplayList::dlNet* nets = dl->nets();
+	const gerbvQtDisplayList::dlNet& rec = nets[index];
+	unpackNet(net, cirseg, rec);
+
+	//Polygon: link its nets, so gerbvQt::generatePareaPolygon can walk them
+	if(rec.vertexCount > 0) {
+		polygon.resize(rec.vertexCount);
+		polygonCirsegs.resize(rec.vertexCount);
+		for(int i = 0; i < rec.vertexCount; i++) {
+			unpackNet(polygon[i], polygonCirsegs[i], nets[index + 1 + i]);
+			if(i > 0) {polygon[i - 1].next = &polygon[i];}
+		}
+		net.next = &polygon[0];
+	}
+	return &net;
+}
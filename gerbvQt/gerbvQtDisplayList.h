@@ -0,0 +1,213 @@
+/*
+
+    This file is part of gerbvQt.
+    (c) Kurganov Alexander, 2016 me@sx107.ru
+
+    gerbvQt is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    Foobar is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with gerbvQt.  If not, see <http://www.gnu.org/licenses/>.
+
+*/
+
+
+#ifndef GERBVQTDISPLAYLIST
+#define GERBVQTDISPLAYLIST
+#include "gerbv.h"
+#include "gerbvQt.h"
+#include <QByteArray>
+#include <QString>
+#include <QFile>
+#include <vector>
+
+//Version of the binary format, bump it on every change of the records below
+#define GERBVQT_DISPLAYLIST_VERSION 2
+
+//The render-ready geometry of a gerbv_image_t in one flat binary block.
+//
+//The block can be saved to a file and memory-mapped back, so reloading a big Gerber
+//doesn't need libgerbv parsing at all. The file is keyed by the canonical path of the source file,
+//and it is valid while the size and the modification time of the source match (see openCached).
+//
+//Typical usage:
+//	gerbvQtDisplayList dl;
+//	dl.openCached("board.gbr", "cache/");		//Parses and caches the file only once
+//	gqt.renderDisplayListToQt(&qtimage, &dl, transform, &renderInfo);
+//
+//The nets are read straight from the mapped file. Only the small tables (apertures, macros,
+//layers, netstates) are unpacked into gerbv structures, so the renderer can use them as usual.
+class gerbvQtDisplayList {
+	public:
+		//Records of the binary format. All the integers are 32-bit, all the records are 8-byte aligned.
+		struct dlHeader {
+			char magic[8];			//"GERBVQDL"
+			quint32 version;		//GERBVQT_DISPLAYLIST_VERSION
+			quint32 byteOrder;		//0x01020304 in the native byte order
+			char sourceHash[16];		//MD5 of the source file (or zeros)
+			quint64 sourceSize;		//Size and modification time (ms since the epoch) of the source file (or zeros)
+			qint64 sourceTime;
+			quint64 offset[7];		//Offsets of the sections (see dlSection) from the start of the block
+			quint64 count[7];		//Number of records in every section
+		};
+
+		enum dlSection {dl_Info, dl_Apertures, dl_Primitives, dl_Layers, dl_States, dl_Cirsegs, dl_Nets, dl_SectionCount};
+
+		struct dlInfo {
+			double min_x, min_y, max_x, max_y;
+			double offsetA, offsetB;
+			double imageRotation;
+			double imageJustifyOffsetActualA, imageJustifyOffsetActualB;
+			qint32 polarity;
+			qint32 layertype;
+		};
+
+		struct dlAperture {
+			qint32 number;			//Index in gerbv_image_t::aperture
+			qint32 type;
+			qint32 firstPrimitive;		//Evaluated macro primitives (dl_Primitives), macros only
+			qint32 primitiveCount;
+			qint32 unit;
+			qint32 nufParameters;
+			double parameter[APERTURE_PARAMETERS_MAX];
+		};
+
+		struct dlPrimitive {
+			qint32 type;
+			qint32 reserved;
+			double parameter[APERTURE_PARAMETERS_MAX];
+		};
+
+		struct dlLayer {
+			double rotation;
+			double srDistX, srDistY;
+			double koLowerLeftX, koLowerLeftY, koWidth, koHeight, koBorder;
+			qint32 polarity;
+			qint32 srX, srY;
+			qint32 koFirstInstance;
+			qint32 koType;
+			qint32 koPolarity;
+		};
+
+		struct dlState {
+			double offsetA, offsetB, scaleA, scaleB;
+			qint32 axisSelect;
+			qint32 mirrorState;
+			qint32 unit;
+			qint32 reserved;
+		};
+
+		struct dlCirseg {
+			double cp_x, cp_y, width, height, angle1, angle2;
+		};
+
+		//The renderable nets in the render order. A GERBV_INTERPOLATION_PAREA_START net
+		//is followed by its vertexCount polygon nets, up to and including the PAREA_END one.
+		struct dlNet {
+			double start_x, start_y, stop_x, stop_y;
+			double bboxLeft, bboxRight, bboxBottom, bboxTop;
+			qint32 aperture;
+			qint32 apertureState;
+			qint32 interpolation;
+			qint32 layer;			//Index in dl_Layers
+			qint32 state;			//Index in dl_States
+			qint32 cirseg;			//Index in dl_Cirsegs or -1
+			qint32 vertexCount;
+			qint32 reserved;
+		};
+
+		gerbvQtDisplayList();
+		~gerbvQtDisplayList();
+
+		//Builds the display list from a parsed image. The hash, the size and the modification time of the source
+		//are stored in the header (see hashFile, openCached).
+		bool compile(const gerbv_image_t* gImage, const QByteArray& sourceHash = QByteArray(), qint64 sourceSize = 0, qint64 sourceTime = 0);
+
+		//Saves the display list to a file
+		bool save(const QString& fileName) const;
+
+		//Memory-maps a saved display list. If sourceHash isn't empty, it must match the stored one.
+		bool load(const QString& fileName, const QByteArray& sourceHash = QByteArray());
+
+		//Loads the display list of sourceFile from cacheDir, or parses sourceFile with libgerbv,
+		//compiles it and saves it to cacheDir for the next time.
+		//The source is read only if its size or modification time differ from the cached ones: then its
+		//hash decides whether the cache is still valid (the stored time is updated) or the file is parsed again.
+		bool openCached(const QString& sourceFile, const QString& cacheDir);
+
+		//Frees everything
+		void clear();
+
+		//MD5 of the file contents
+		static QByteArray hashFile(const QString& fileName);
+
+		//File name of the cached display list of the source file (keyed by the MD5 of its canonical path)
+		static QString cacheFileName(const QString& cacheDir, const QString& sourceFile);
+
+		//A gerbv_image_t shell with the info and the aperture table, but without the netlist.
+		//NULL if nothing is compiled/loaded.
+		const gerbv_image_t* image(void) const {return shell;}
+
+		//Raw access to the records
+		const dlHeader* header(void) const {return reinterpret_cast<const dlHeader*>(data);}
+		int netCount(void) const {return data ? int(header()->count[dl_Nets]) : 0;}
+		const dlNet* nets(void) const {return section<dlNet>(dl_Nets);}
+		const dlCirseg* cirsegs(void) const {return section<dlCirseg>(dl_Cirsegs);}
+		gerbv_layer_t* layer(int i) const {return const_cast<gerbv_layer_t*>(&layers[i]);}
+		gerbv_netstate_t* state(int i) const {return const_cast<gerbv_netstate_t*>(&states[i]);}
+
+	private:
+		//Forbid copying, the unpacked tables point into each other
+		gerbvQtDisplayList(const gerbvQtDisplayList&);
+		gerbvQtDisplayList& operator=(const gerbvQtDisplayList&);
+
+		template<class T> const T* section(dlSection s) const {
+			return data ? reinterpret_cast<const T*>(data + header()->offset[s]) : NULL;
+		}
+
+		bool validate(qint64 size, const QByteArray& sourceHash);
+		static bool stampSource(const QString& fileName, qint64 sourceSize, qint64 sourceTime);
+		void unpack();
+
+		const char* data;		//Either storage.constData() or the mapped file
+		qint64 dataSize;
+		QByteArray storage;
+		QFile mapFile;
+		uchar* mapped;
+
+		//Unpacked tables
+		gerbv_image_t* shell;
+		gerbv_image_info_t shellInfo;
+		std::vector<gerbv_aperture_t> apertures;
+		std::vector<gerbv_simplified_amacro_t> primitives;
+		std::vector<gerbv_layer_t> layers;
+		std::vector<gerbv_netstate_t> states;
+};
+
+//Walks the nets of a display list, unpacking them one by one
+class gerbvQtDisplayListNets : public gerbvQtNetSource {
+	public:
+		gerbvQtDisplayListNets(const gerbvQtDisplayList* _displayList) : dl(_displayList), index(0) {}
+		const gerbv_net_t* first() {index = 0; return unpack();}
+		const gerbv_net_t* next();
+
+	private:
+		const gerbv_net_t* unpack();
+		void unpackNet(gerbv_net_t& net, gerbv_cirseg_t& cirseg, const gerbvQtDisplayList::dlNet& rec);
+
+		const gerbvQtDisplayList* dl;
+		int index;
+		gerbv_net_t net;
+		gerbv_cirseg_t cirseg;
+		std::vector<gerbv_net_t> polygon;
+		std::vector<gerbv_cirseg_t> polygonCirsegs;
+};
+
+#endif
@@ -0,0 +1,440 @@
+/*
+
+    This file is part of gerbvQt.
+    (c) Kurganov Alexander, 2016 me@sx107.ru
+
+    gerbvQt is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    Foobar is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with gerbvQt.  If not, see <http://www.gnu.org/licenses/>.
+
+*/
+
+//Fixed point pipeline (see gerbvQt::setFixedPoint).
+//
+//Every coordinate is rounded once, in the full picture coordinates, to 1/256 of a pixel.
+//Everything after that (culling, curve flattening, scan conversion) is integer math, so the
+//result depends neither on the device origin nor on the floating point rounding of the kernels.
+//Pixels are filled if their centers are inside, the same rule QPainter uses for aliased fills.
+
+#include "gerbvQt.h"
+#include <cmath>
+#include <algorithm>
+#include <limits>
+#include <climits>
+
+using namespace std;
+
+static const qint64 fixedOne = qint64(1) << GERBVQT_FIXED_SHIFT;
+static const qint64 fixedHalf = fixedOne / 2;
+
+//Coordinates are limited to +-2^19 pixels, so the products of two differences fit into 64 bits
+static const qint64 fixedLimit = qint64(1) << 27;
+
+//Flatness of the curves: maximal second difference of the control points (1/16 pixel)
+static const qint64 fixedFlatness = fixedOne / 16;
+
+static inline qint64 floorDiv(qint64 a, qint64 b) {
+	if(b < 0) {a = -a; b = -b;}
+	return a >= 0 ? a / b : -((-a + b - 1) / b);
+}
+
+static inline qint64 ceilDiv(qint64 a, qint64 b) {
+	return -floorDiv(-a, b);
+}
+
+//Floor of the square root
+static inline qint64 isqrt(qint64 n) {
+	if(n <= 0) {return 0;}
+	qint64 r = qint64(sqrt(double(n)));
+	while(r*r > n) {r--;}
+	while((r + 1)*(r + 1) <= n) {r++;}
+	return r;
+}
+
+//First pixel with the center at or after x
+static inline int pixelFrom(qint64 x) {
+	return int(qBound(qint64(INT_MIN / 2), ceilDiv(x - fixedHalf, fixedOne), qint64(INT_MAX / 2)));
+}
+
+//Rounds a length in pixels, false if it is out of range
+static inline bool lengthToFixed(double length, qint64& v) {
+	double f = floor(length * fixedOne + 0.5);
+	if(!(f >= 0.0 && f < fixedLimit)) {return false;}
+	v = qint64(f);
+	return true;
+}
+
+bool gerbvQt::toFixed(const QPointF& point, fixedVertex& v) {
+	//The world transform doesn't contain the device origin (see renderNets),
+	//the integer origin is subtracted after the rounding
+	QPointF p = painter->transform().map(point);
+	double fx = floor(p.x() * fixedOne + 0.5);
+	double fy = floor(p.y() * fixedOne + 0.5);
+	if(!(fabs(fx) < fixedLimit && fabs(fy) < fixedLimit)) {return false;}
+	v.x = qint64(fx) - qint64(origin.x()) * fixedOne;
+	v.y = qint64(fy) - qint64(origin.y()) * fixedOne;
+	return true;
+}
+
+//Is the box (in the device fixed point coordinates) completely outside of the device?
+static inline bool fixedOutside(qint64 x0, qint64 y0, qint64 x1, qint64 y1, const QPaintDevice* device, qint64 margin) {
+	return x1 < -margin || y1 < -margin ||
+		x0 >= qint64(device->width()) * fixedOne + margin ||
+		y0 >= qint64(device->height()) * fixedOne + margin;
+}
+
+bool gerbvQt::fixedCulled(const gerbv_image_t* gImage, const gerbv_net_t* cNet) {
+	//A conservative box of the net in the image coordinates: the path extended by the aperture size.
+	//Macros and regions aren't culled here, the path fills cull themselves.
+	if(!useFixed || cNet->interpolation == GERBV_INTERPOLATION_PAREA_START) {return false;}
+	gerbv_aperture_t* ap = gImage->aperture[cNet->aperture];
+	if(ap == NULL) {return false;}
+
+	double ext;
+	switch(ap->type) {
+		case GERBV_APTYPE_CIRCLE:
+		case GERBV_APTYPE_POLYGON:
+			ext = ap->parameter[0] / 2.0;
+			break;
+		case GERBV_APTYPE_RECTANGLE:
+		case GERBV_APTYPE_OVAL:
+			ext = (ap->parameter[0] + ap->parameter[1]) / 2.0;
+			break;
+		default:
+			return false;
+	}
+
+	double x0, y0, x1, y1;
+	if(cNet->aperture_state == GERBV_APERTURE_STATE_FLASH) {
+		x0 = x1 = cNet->stop_x;
+		y0 = y1 = cNet->stop_y;
+	} else if((cNet->interpolation == GERBV_INTERPOLATION_CW_CIRCULAR ||
+		   cNet->interpolation == GERBV_INTERPOLATION_CCW_CIRCULAR) && cNet->cirseg != NULL) {
+		double r = qMax(fabs(cNet->cirseg->width), fabs(cNet->cirseg->height)) / 2.0;
+		x0 = cNet->cirseg->cp_x - r; x1 = cNet->cirseg->cp_x + r;
+		y0 = cNet->cirseg->cp_y - r; y1 = cNet->cirseg->cp_y + r;
+	} else {
+		x0 = qMin(cNet->start_x, cNet->stop_x); x1 = qMax(cNet->start_x, cNet->stop_x);
+		y0 = qMin(cNet->start_y, cNet->stop_y); y1 = qMax(cNet->start_y, cNet->stop_y);
+	}
+	x0 -= ext; y0 -= ext; x1 += ext; y1 += ext;
+
+	const QPointF corners[4] = {QPointF(x0, y0), QPointF(x1, y0), QPointF(x0, y1), QPointF(x1, y1)};
+	fixedVertex v;
+	qint64 bx0 = 0, by0 = 0, bx1 = 0, by1 = 0;
+	for(int i = 0; i < 4; i++) {
+		if(!toFixed(corners[i], v)) {return false;}
+		if(i == 0 || v.x < bx0) {bx0 = v.x;}
+		if(i == 0 || v.x > bx1) {bx1 = v.x;}
+		if(i == 0 || v.y < by0) {by0 = v.y;}
+		if(i == 0 || v.y > by1) {by1 = v.y;}
+	}
+
+	//One pixel margin for the antialiasing and the cosmetic pens of QPainter
+	return fixedOutside(bx0, by0, bx1, by1, painter->device(), fixedOne);
+}
+
+void gerbvQt::fillPath(const QPainterPath& path) {
+	if(fillPathFixed(path)) {return;}
+	painter->fillPath(path, painter->brush());
+}
+
+void gerbvQt::addFixedEdge(std::vector<fixedEdge>& edges, const fixedVertex& p, const fixedVertex& q) {
+	if(p.y == q.y) {return;}
+	fixedEdge e;
+	if(p.y < q.y) {
+		e.x0 = p.x; e.y0 = p.y; e.x1 = q.x; e.y1 = q.y; e.dir = 1;
+	} else {
+		e.x0 = q.x; e.y0 = q.y; e.x1 = p.x; e.y1 = p.y; e.dir = -1;
+	}
+	edges.push_back(e);
+}
+
+void gerbvQt::flattenFixedCubic(std::vector<fixedEdge>& edges, const fixedVertex* p, int depth) {
+	//De Casteljau subdivision with integer midpoints, until the second differences
+	//of the control points (which bound the distance to the chord) are small enough
+	qint64 dd = qMax(qMax(qAbs(p[0].x - 2*p[1].x + p[2].x), qAbs(p[0].y - 2*p[1].y + p[2].y)),
+			 qMax(qAbs(p[1].x - 2*p[2].x + p[3].x), qAbs(p[1].y - 2*p[2].y + p[3].y)));
+	if(dd <= fixedFlatness || depth >= 16) {
+		addFixedEdge(edges, p[0], p[3]);
+		return;
+	}
+
+	auto mid = [](const fixedVertex& a, const fixedVertex& b) {
+		fixedVertex m;
+		m.x = floorDiv(a.x + b.x, 2);
+		m.y = floorDiv(a.y + b.y, 2);
+		return m;
+	};
+	fixedVertex p01 = mid(p[0], p[1]), p12 = mid(p[1], p[2]), p23 = mid(p[2], p[3]);
+	fixedVertex p012 = mid(p01, p12), p123 = mid(p12, p23);
+	fixedVertex p0123 = mid(p012, p123);
+
+	const fixedVertex left[4] = {p[0], p01, p012, p0123};
+	const fixedVertex right[4] = {p0123, p123, p23, p[3]};
+	flattenFixedCubic(edges, left, depth + 1);
+	flattenFixedCubic(edges, right, depth + 1);
+}
+
+bool gerbvQt::fillPathFixed(const QPainterPath& path) {
+	if(!useFixed || !spansReady()) {return false;}
+
+	//Round all the points (including the curve control points) first
+	int n = path.elementCount();
+	if(n == 0) {return true;}
+	std::vector<fixedVertex> pts(n);
+	std::vector<int> types(n);
+	for(int i = 0; i < n; i++) {
+		QPainterPath::Element e = path.elementAt(i);
+		if(!toFixed(QPointF(e.x, e.y), pts[i])) {return false;}
+		types[i] = e.type;
+	}
+
+	//The curves are inside the hull of their control points
+	qint64 bx0 = pts[0].x, by0 = pts[0].y, bx1 = pts[0].x, by1 = pts[0].y;
+	for(int i = 1; i < n; i++) {
+		bx0 = qMin(bx0, pts[i].x); bx1 = qMax(bx1, pts[i].x);
+		by0 = qMin(by0, pts[i].y); by1 = qMax(by1, pts[i].y);
+	}
+	if(fixedOutside(bx0, by0, bx1, by1, spanImage, 0)) {return true;}
+
+	//Edges, every subpath is implicitly closed
+	std::vector<fixedEdge> edges;
+	int subpathStart = -1;
+	for(int i = 0; i < n; i++) {
+		switch(types[i]) {
+			case QPainterPath::MoveToElement:
+				if(subpathStart >= 0) {addFixedEdge(edges, pts[i - 1], pts[subpathStart]);}
+				subpathStart = i;
+				break;
+			case QPainterPath::LineToElement:
+				if(i > 0) {addFixedEdge(edges, pts[i - 1], pts[i]);}
+				break;
+			case QPainterPath::CurveToElement:
+				if(i > 0 && i + 2 < n) {
+					flattenFixedCubic(edges, &pts[i - 1], 0);
+					i += 2;
+				}
+				break;
+			default:
+				break;
+		}
+	}
+	if(subpathStart >= 0) {addFixedEdge(edges, pts[n - 1], pts[subpathStart]);}
+
+	fillFixedEdges(edges, path.fillRule() == Qt::WindingFill);
+	return true;
+}
+
+void gerbvQt::fillFixedEdges(std::vector<fixedEdge>& edges, bool winding) {
+	//Scanline conversion with an active edge list. The crossings with the row centers are
+	//computed exactly (floor division), the pixels with the centers in [left, right) are filled.
+	if(edges.empty()) {return;}
+	std::sort(edges.begin(), edges.end(), [](const fixedEdge& a, const fixedEdge& b) {return a.y0 < b.y0;});
+
+	qint64 yMax = edges[0].y1;
+	for(size_t i = 1; i < edges.size(); i++) {yMax = qMax(yMax, edges[i].y1);}
+
+	int yFrom = qMax(0, pixelFrom(edges[0].y0));
+	int yTo = qMin(spanImage->height(), pixelFrom(yMax));
+
+	std::vector<const fixedEdge*> active;
+	std::vector<std::pair<qint64, int> > crossings;
+	size_t nextEdge = 0;
+	for(int y = yFrom; y < yTo; y++) {
+		qint64 yc = qint64(y) * fixedOne + fixedHalf;
+
+		//Update the active edges: the ones with y0 <= yc < y1
+		while(nextEdge < edges.size() && edges[nextEdge].y0 <= yc) {
+			if(edges[nextEdge].y1 > yc) {active.push_back(&edges[nextEdge]);}
+			nextEdge++;
+		}
+		active.erase(std::remove_if(active.begin(), active.end(), [yc](const fixedEdge* e) {return e->y1 <= yc;}), active.end());
+		if(active.empty()) {continue;}
+
+		crossings.clear();
+		for(size_t i = 0; i < active.size(); i++) {
+			const fixedEdge* e = active[i];
+			qint64 x = e->x0 + floorDiv((yc - e->y0) * (e->x1 - e->x0), e->y1 - e->y0);
+			crossings.push_back(std::make_pair(x, e->dir));
+		}
+		std::sort(crossings.begin(), crossings.end());
+
+		int w = 0;
+		qint64 spanStart = 0;
+		for(size_t i = 0; i < crossings.size(); i++) {
+			bool wasInside = winding ? (w != 0) : (w & 1);
+			w += winding ? crossings[i].second : 1;
+			bool isInside = winding ? (w != 0) : (w & 1);
+			if(!wasInside && isInside) {spanStart = crossings[i].first;}
+			else if(wasInside && !isInside) {fillSpan(y, pixelFrom(spanStart), pixelFrom(crossings[i].first));}
+		}
+	}
+}
+
+void gerbvQt::fillFixedDisc(const fixedVertex& c, qint64 r) {
+	int yFrom = qMax(0, pixelFrom(c.y - r));
+	int yTo = qMin(spanImage->height(), pixelFrom(c.y + r + 1));
+	for(int y = yFrom; y < yTo; y++) {
+		qint64 dy = qint64(y) * fixedOne + fixedHalf - c.y;
+		qint64 h2 = r*r - dy*dy;
+		if(h2 < 0) {continue;}
+		qint64 h = isqrt(h2);
+		fillSpan(y, pixelFrom(c.x - h), pixelFrom(c.x + h + 1));
+	}
+}
+
+bool gerbvQt::fixedCapsule(const QPointF& start, const QPointF& stop, double radius) {
+	//The same geometry as drawCapsule, in integers
+	fixedVertex a, b;
+	qint64 r;
+	if(!toFixed(start, a) || !toFixed(stop, b) || !lengthToFixed(radius, r)) {return false;}
+	if(fixedOutside(qMin(a.x, b.x) - r, qMin(a.y, b.y) - r, qMax(a.x, b.x) + r, qMax(a.y, b.y) + r, spanImage, 0)) {return true;}
+
+	qint64 dx = b.x - a.x;
+	qint64 dy = b.y - a.y;
+	qint64 len2 = dx*dx + dy*dy;
+	if(len2 == 0) {
+		fillFixedDisc(a, r);
+		return true;
+	}
+	qint64 rl = r * isqrt(len2);
+
+	int yFrom = qMax(0, pixelFrom(qMin(a.y, b.y) - r));
+	int yTo = qMin(spanImage->height(), pixelFrom(qMax(a.y, b.y) + r + 1));
+
+	for(int y = yFrom; y < yTo; y++) {
+		qint64 yc = qint64(y) * fixedOne + fixedHalf;
+		bool any = false;
+		qint64 xl = 0, xr = 0;
+
+		//End discs
+		for(int i = 0; i < 2; i++) {
+			const fixedVertex& c = i ? b : a;
+			qint64 d = yc - c.y;
+			qint64 h2 = r*r - d*d;
+			if(h2 < 0) {continue;}
+			qint64 h = isqrt(h2);
+			if(!any || c.x - h < xl) {xl = c.x - h;}
+			if(!any || c.x + h > xr) {xr = c.x + h;}
+			any = true;
+		}
+
+		//The rectangle: |cross(d, p - a)| <= r*|d| and 0 <= dot(d, p - a) <= |d|^2
+		qint64 ey = yc - a.y;
+		qint64 lo = numeric_limits<qint64>::min(), hi = numeric_limits<qint64>::max();
+		bool inside = true;
+		if(dy != 0) {
+			qint64 u = a.x + floorDiv(dx*ey - rl, dy);
+			qint64 v = a.x + floorDiv(dx*ey + rl, dy);
+			lo = qMax(lo, qMin(u, v));
+			hi = qMin(hi, qMax(u, v));
+		} else if(qAbs(dx*ey) > rl) {inside = false;}
+		if(dx != 0) {
+			qint64 u = a.x + floorDiv(-dy*ey, dx);
+			qint64 v = a.x + floorDiv(len2 - dy*ey, dx);
+			lo = qMax(lo, qMin(u, v));
+			hi = qMin(hi, qMax(u, v));
+		} else if(dy*ey < 0 || dy*ey > len2) {inside = false;}
+		if(inside && lo <= hi) {
+			if(!any || lo < xl) {xl = lo;}
+			if(!any || hi > xr) {xr = hi;}
+			any = true;
+		}
+
+		if(any) {fillSpan(y, pixelFrom(xl), pixelFrom(xr + 1));}
+	}
+	return true;
+}
+
+bool gerbvQt::fixedPolygon(const QPointF* points, int numPoints) {
+	std::vector<fixedEdge> edges;
+	fixedVertex v[8];
+	for(int i = 0; i < numPoints; i++) {
+		if(!toFixed(points[i], v[i])) {return false;}
+	}
+	for(int i = 0; i < numPoints; i++) {addFixedEdge(edges, v[i], v[(i + 1) % numPoints]);}
+	fillFixedEdges(edges, true);
+	return true;
+}
+
+bool gerbvQt::fixedArc(const QPointF& center, const QPointF* ends, double radius, double halfWidth, double sweep) {
+	//The same geometry as drawArcCapsule, in integers. ends are the start, the end and the middle of the arc.
+	fixedVertex c, s, e, m;
+	qint64 R, hw, rOut, rIn;
+	if(!toFixed(center, c) || !toFixed(ends[0], s) || !toFixed(ends[1], e) || !toFixed(ends[2], m)) {return false;}
+	if(!lengthToFixed(radius, R) || !lengthToFixed(halfWidth, hw) || !lengthToFixed(radius + halfWidth, rOut)) {return false;}
+	rIn = qMax(qint64(0), R - hw);
+
+	qint64 sx = s.x - c.x, sy = s.y - c.y;
+	qint64 ex = e.x - c.x, ey = e.y - c.y;
+	int o = (sx*(m.y - c.y) - sy*(m.x - c.x)) < 0 ? -1 : 1;
+	bool full = (sweep >= 360.0);
+	bool wide = (sweep > 180.0);
+	auto inSector = [&](qint64 px, qint64 py) {
+		if(full) {return true;}
+		qint64 cs = o * (sx*py - sy*px);
+		qint64 ce = o * (px*ey - py*ex);
+		if(wide) {return cs >= 0 || ce >= 0;}
+		return cs >= 0 && ce >= 0;
+	};
+
+	//Bounding box: the end discs and the extreme points of the circle that are on the arc
+	qint64 bx0 = qMin(s.x, e.x) - hw, bx1 = qMax(s.x, e.x) + hw;
+	qint64 by0 = qMin(s.y, e.y) - hw, by1 = qMax(s.y, e.y) + hw;
+	const qint64 ext[4][2] = {{R, 0}, {-R, 0}, {0, R}, {0, -R}};
+	for(int i = 0; i < 4; i++) {
+		if(!inSector(ext[i][0], ext[i][1])) {continue;}
+		bx0 = qMin(bx0, c.x + ext[i][0] - hw);
+		bx1 = qMax(bx1, c.x + ext[i][0] + hw);
+		by0 = qMin(by0, c.y + ext[i][1] - hw);
+		by1 = qMax(by1, c.y + ext[i][1] + hw);
+	}
+	if(fixedOutside(bx0, by0, bx1, by1, spanImage, 0)) {return true;}
+
+	int yFrom = qMax(0, pixelFrom(by0));
+	int yTo = qMin(spanImage->height(), pixelFrom(by1 + 1));
+	int xMin = qMax(0, pixelFrom(bx0));
+	int xMax = qMin(spanImage->width(), pixelFrom(bx1 + 1));
+
+	for(int y = yFrom; y < yTo; y++) {
+		qint64 py = qint64(y) * fixedOne + fixedHalf - c.y;
+		qint64 ho2 = rOut*rOut - py*py;
+		if(ho2 < 0) {continue;}
+		qint64 ho = isqrt(ho2);
+		qint64 hi2 = rIn*rIn - py*py;
+		qint64 hi = hi2 > 0 ? isqrt(hi2) : -1;
+
+		//One or two intervals of the annulus on this row
+		qint64 iv[2][2] = {{c.x - ho, hi >= 0 ? c.x - hi : c.x + ho}, {c.x + hi, c.x + ho}};
+		int intervals = hi >= 0 ? 2 : 1;
+		for(int k = 0; k < intervals; k++) {
+			int x0 = qMax(xMin, pixelFrom(iv[k][0]));
+			int x1 = qMin(xMax, pixelFrom(iv[k][1] + 1));
+			int runStart = -1;
+			for(int x = x0; x < x1; x++) {
+				if(inSector(qint64(x) * fixedOne + fixedHalf - c.x, py)) {
+					if(runStart < 0) {runStart = x;}
+				} else if(runStart >= 0) {
+					fillSpan(y, runStart, x);
+					runStart = -1;
+				}
+			}
+			if(runStart >= 0) {fillSpan(y, runStart, x1);}
+		}
+	}
+
+	//Round caps
+	fillFixedDisc(s, hw);
+	fillFixedDisc(e, hw);
+	return true;
+}
@@ -0,0 +1,519 @@
+/*
+
+    This file is part of gerbvQt.
+    (c) Kurganov Alexander, 2016 me@sx107.ru
+
+    gerbvQt is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    Foobar is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with gerbvQt.  If not, see <http://www.gnu.org/licenses/>.
+
+*/
+
+#include "gerbvQtImageWriter.h"
+#include <zlib.h>
+#include <iostream>
+#include <cstring>
+#include <climits>
+#include <thread>
+
+using namespace std;
+
+//zlib takes the sizes as uInt, bigger buffers are fed in pieces
+static const size_t zlibPiece = size_t(1) << 30;
+
+//Reverses the bit order of a byte (Format_MonoLSB -> Format_Mono)
+static inline uchar reverseBits(uchar b) {
+	b = uchar((b & 0xF0) >> 4 | (b & 0x0F) << 4);
+	b = uchar((b & 0xCC) >> 2 | (b & 0x33) << 2);
+	b = uchar((b & 0xAA) >> 1 | (b & 0x55) << 1);
+	return b;
+}
+
+static inline void putBE32(std::vector<uchar>& v, quint32 x) {
+	v.push_back(uchar(x >> 24)); v.push_back(uchar(x >> 16)); v.push_back(uchar(x >> 8)); v.push_back(uchar(x));
+}
+
+static inline void putLE16(std::vector<uchar>& v, quint32 x) {
+	v.push_back(uchar(x)); v.push_back(uchar(x >> 8));
+}
+
+static inline void putLE32(std::vector<uchar>& v, quint32 x) {
+	putLE16(v, x & 0xFFFF); putLE16(v, x >> 16);
+}
+
+//Appends a PNG chunk: length, type, data, CRC of the type and the data
+static void appendChunk(std::vector<uchar>& v, const char* type, const uchar* data, quint32 size) {
+	putBE32(v, size);
+	v.insert(v.end(), type, type + 4);
+	v.insert(v.end(), data, data + size);
+	uLong crc = crc32(0L, reinterpret_cast<const Bytef*>(type), 4);
+	crc = crc32(crc, data, size);
+	putBE32(v, quint32(crc));
+}
+
+gerbvQtImageWriter::gerbvQtImageWriter() {
+	height = 0;
+	rowsWritten = 0;
+	stripRows = 0;
+	failed = false;
+	maxPending = 2;
+	adler = 1;
+	filePos = 0;
+	photometric = 0;
+	params = encodeParams();
+}
+
+gerbvQtImageWriter::~gerbvQtImageWriter() {
+	if(file.isOpen()) {close();}
+}
+
+gerbvQtImageWriter::fileFormat gerbvQtImageWriter::formatFromName(const QString& fileName) {
+	QString name = fileName.toLower();
+	if(name.endsWith(".tif") || name.endsWith(".tiff")) {return ff_TIFF;}
+	if(name.endsWith(".pbm")) {return ff_PBM;}
+	return ff_PNG;
+}
+
+int gerbvQtImageWriter::rowBytes(sampleLayout layout, int width) {
+	switch(layout) {
+		case sl_Bits: return (width + 7) / 8;
+		case sl_Gray: return width;
+		case sl_RGB: return width * 3;
+		default: return width * 4;
+	}
+}
+
+bool gerbvQtImageWriter::write(	const QImage& image,
+				const QString& fileName,
+				fileFormat format,
+				int level,
+				int bandRows) {
+
+	gerbvQtImageWriter writer;
+	if(!writer.open(fileName, image.width(), image.height(), image.format(), image.colorTable(), format, level)) {return false;}
+
+	//About 4 MB per band, but at least 4 bands per core
+	if(bandRows <= 0) {
+		int threads = qMax(1, int(std::thread::hardware_concurrency()));
+		qint64 bySize = qMax(qint64(1), qint64(4 << 20) / qMax(1, image.bytesPerLine()));
+		qint64 byCores = (qint64(image.height()) + threads*4 - 1) / (threads*4);
+		bandRows = int(qBound(qint64(16), qMin(bySize, byCores), qint64(INT_MAX)));
+	}
+
+	for(int y = 0; y < image.height(); y += bandRows) {
+		if(!writer.writeRows(image, y, qMin(bandRows, image.height() - y))) {break;}
+	}
+	return writer.close();
+}
+
+bool gerbvQtImageWriter::open(	const QString& fileName,
+				int width,
+				int _height,
+				QImage::Format imageFormat,
+				const QVector<QRgb>& colorTable,
+				fileFormat format,
+				int level) {
+
+	if(file.isOpen()) {close();}
+	if(width <= 0 || _height <= 0) {
+		cerr << "gerbvQtImageWriter: empty image." << endl;
+		return false;
+	}
+	if(format == ff_Auto) {format = formatFromName(fileName);}
+
+	sampleLayout layout;
+	switch(imageFormat) {
+		case QImage::Format_Mono:
+		case QImage::Format_MonoLSB: layout = sl_Bits; break;
+		case QImage::Format_Grayscale8:
+		case QImage::Format_Alpha8: layout = sl_Gray; break;
+		case QImage::Format_RGB32: layout = sl_RGB; break;
+		default: layout = sl_RGBA; break;
+	}
+	if(format == ff_PBM && layout != sl_Bits) {
+		cerr << "gerbvQtImageWriter: PBM files need a 1bpp image." << endl;
+		return false;
+	}
+
+	//Which index is the dark one
+	QVector<QRgb> colors = colorTable;
+	if(layout == sl_Bits && colors.size() < 2) {
+		colors.clear();
+		colors.append(qRgb(255, 255, 255));
+		colors.append(qRgb(0, 0, 0));
+	}
+	bool oneIsDark = (layout == sl_Bits) && qGray(colors[1]) < qGray(colors[0]);
+
+	file.setFileName(fileName);
+	if(!file.open(QFile::WriteOnly | QFile::Truncate)) {
+		cerr << "gerbvQtImageWriter: can't open " << fileName.toLocal8Bit().constData() << endl;
+		return false;
+	}
+
+	params.format = format;
+	params.layout = layout;
+	params.width = width;
+	params.level = level;
+	params.invertBits = (format == ff_PBM && !oneIsDark);
+	params.last = false;
+	height = _height;
+	rowsWritten = 0;
+	stripRows = 0;
+	failed = false;
+	adler = adler32(0L, Z_NULL, 0);
+	stripOffsets.clear();
+	stripSizes.clear();
+	filePos = 0;
+	maxPending = 2 * size_t(qMax(1, int(std::thread::hardware_concurrency())));
+
+	//Photometric interpretation of TIFF
+	switch(layout) {
+		case sl_Bits: photometric = oneIsDark ? 0 : 1; break;	//WhiteIsZero : BlackIsZero
+		case sl_Gray: photometric = 1; break;
+		default: photometric = 2; break;			//RGB
+	}
+
+	std::vector<uchar> header;
+	switch(format) {
+		case ff_PNG: {
+			static const uchar signature[8] = {137, 80, 78, 71, 13, 10, 26, 10};
+			header.insert(header.end(), signature, signature + 8);
+
+			std::vector<uchar> ihdr;
+			putBE32(ihdr, width);
+			putBE32(ihdr, height);
+			ihdr.push_back(layout == sl_Bits ? 1 : 8);	//Bit depth
+			switch(layout) {				//Color type
+				case sl_Bits: ihdr.push_back(3); break;
+				case sl_Gray: ihdr.push_back(0); break;
+				case sl_RGB: ihdr.push_back(2); break;
+				default: ihdr.push_back(6); break;
+			}
+			ihdr.push_back(0); ihdr.push_back(0); ihdr.push_back(0);	//Compression, filter, interlace
+			appendChunk(header, "IHDR", ihdr.data(), quint32(ihdr.size()));
+
+			if(layout == sl_Bits) {
+				uchar plte[6] = {	uchar(qRed(colors[0])), uchar(qGreen(colors[0])), uchar(qBlue(colors[0])),
+							uchar(qRed(colors[1])), uchar(qGreen(colors[1])), uchar(qBlue(colors[1]))};
+				appendChunk(header, "PLTE", plte, 6);
+			}
+
+			//The zlib header, the bands bring the raw deflate data
+			static const uchar zlibHeader[2] = {0x78, 0x9C};
+			appendChunk(header, "IDAT", zlibHeader, 2);
+		}
+		break;
+		case ff_TIFF:
+			header.push_back('I'); header.push_back('I');
+			putLE16(header, 42);
+			putLE32(header, 0);	//The IFD offset, written by close()
+			break;
+		default: {
+			QByteArray pbm = "P4\n" + QByteArray::number(width) + " " + QByteArray::number(height) + "\n";
+			header.insert(header.end(), pbm.constData(), pbm.constData() + pbm.size());
+		}
+		break;
+	}
+	if(!writeData(header.data(), header.size())) {
+		file.close();
+		return false;
+	}
+	return true;
+}
+
+bool gerbvQtImageWriter::writeBand(const QImage& band, int rows) {
+	if(rows < 0) {rows = band.height();}
+	return writeRows(band, 0, qMin(rows, band.height()));
+}
+
+bool gerbvQtImageWriter::writeRows(const QImage& image, int y0, int rows) {
+	if(!file.isOpen() || failed) {return false;}
+	rows = qMin(rows, height - rowsWritten);
+	if(image.width() != params.width || rows <= 0) {
+		cerr << "gerbvQtImageWriter: the band doesn't match the image." << endl;
+		failed = true;
+		return false;
+	}
+
+	//TIFF strips must have the same size, except the last one
+	if(params.format == ff_TIFF) {
+		if(stripRows == 0) {stripRows = rows;}
+		else if(rows != stripRows && rowsWritten + rows != height) {
+			cerr << "gerbvQtImageWriter: all the TIFF bands but the last one must have " << stripRows << " rows." << endl;
+			failed = true;
+			return false;
+		}
+	}
+
+	encodeParams p = params;
+	p.last = (rowsWritten + rows == height);
+	pending.push_back(std::async(std::launch::async, &gerbvQtImageWriter::encode, image, y0, rows, p));
+	rowsWritten += rows;
+
+	//Don't keep too many bands in memory: write the oldest ones
+	while(pending.size() > maxPending) {
+		if(!writeEncoded(pending.front().get())) {failed = true;}
+		pending.pop_front();
+	}
+	return !failed;
+}
+
+void gerbvQtImageWriter::convertRow(const QImage& image, int y, sampleLayout layout, bool invertBits, uchar* out) {
+	const uchar* src = image.constScanLine(y);
+	int width = image.width();
+	switch(layout) {
+		case sl_Bits: {
+			int bytes = (width + 7) / 8;
+			bool lsb = (image.format() == QImage::Format_MonoLSB);
+			for(int i = 0; i < bytes; i++) {
+				uchar b = lsb ? reverseBits(src[i]) : src[i];
+				out[i] = invertBits ? uchar(~b) : b;
+			}
+			if(width & 7) {out[bytes - 1] &= uchar(0xFF << (8 - (width & 7)));}
+		}
+		break;
+		case sl_Gray:
+			memcpy(out, src, width);
+			break;
+		case sl_RGB: {
+			const QRgb* px = reinterpret_cast<const QRgb*>(src);
+			for(int x = 0; x < width; x++) {
+				*out++ = uchar(qRed(px[x]));
+				*out++ = uchar(qGreen(px[x]));
+				*out++ = uchar(qBlue(px[x]));
+			}
+		}
+		break;
+		case sl_RGBA: {
+			const QRgb* px = reinterpret_cast<const QRgb*>(src);
+			for(int x = 0; x < width; x++) {
+				*out++ = uchar(qRed(px[x]));
+				*out++ = uchar(qGreen(px[x]));
+				*out++ = uchar(qBlue(px[x]));
+				*out++ = uchar(qAlpha(px[x]));
+			}
+		}
+		break;
+	}
+}
+
+gerbvQtImageWriter::encodedBand gerbvQtImageWriter::encode(QImage image, int y0, int rows, encodeParams p) {
+	//Runs in a worker thread
+	encodedBand band;
+	band.ok = true;
+	band.adler = 1;
+
+	//The formats convertRow reads (Format_ARGB32_Premultiplied is unpremultiplied here)
+	switch(p.layout) {
+		case sl_Bits:
+			if(image.format() != QImage::Format_Mono && image.format() != QImage::Format_MonoLSB) {image = image.convertToFormat(QImage::Format_Mono);}
+			break;
+		case sl_Gray:
+			if(image.format() != QImage::Format_Grayscale8 && image.format() != QImage::Format_Alpha8) {image = image.convertToFormat(QImage::Format_Grayscale8);}
+			break;
+		case sl_RGB:
+			if(image.format() != QImage::Format_RGB32) {image = image.convertToFormat(QImage::Format_RGB32);}
+			break;
+		case sl_RGBA:
+			if(image.format() != QImage::Format_ARGB32) {image = image.convertToFormat(QImage::Format_ARGB32);}
+			break;
+	}
+
+	//Raw rows. PNG rows start with the filter type: None for 1bpp, Sub otherwise (no dependency on the previous band).
+	bool png = (p.format == ff_PNG);
+	int bytes = rowBytes(p.layout, p.width);
+	int bpp = (p.layout == sl_Gray) ? 1 : (p.layout == sl_RGB) ? 3 : 4;
+	size_t stride = size_t(bytes) + (png ? 1 : 0);
+	std::vector<uchar> raw(stride * rows);
+	for(int r = 0; r < rows; r++) {
+		uchar* out = &raw[stride * r];
+		if(png) {
+			*out++ = (p.layout == sl_Bits) ? 0 : 1;
+		}
+		convertRow(image, y0 + r, p.layout, p.invertBits, out);
+		if(png && p.layout != sl_Bits) {
+			for(int i = bytes - 1; i >= bpp; i--) {out[i] = uchar(out[i] - out[i - bpp]);}
+		}
+	}
+	band.rawSize = qint64(raw.size());
+
+	if(p.format == ff_PBM) {
+		band.data.swap(raw);
+		return band;
+	}
+
+	//PNG: raw deflate, TIFF: a complete zlib stream per strip
+	z_stream zs;
+	memset(&zs, 0, sizeof(zs));
+	if(deflateInit2(&zs, p.level, Z_DEFLATED, png ? -15 : 15, 8, Z_DEFAULT_STRATEGY) != Z_OK) {
+		band.ok = false;
+		return band;
+	}
+	bool finish = !png || p.last;
+	std::vector<uchar> packed(deflateBound(&zs, uLong(raw.size())) + 64);
+	zs.next_out = packed.data();
+	zs.avail_out = uInt(qMin(packed.size(), zlibPiece));
+
+	size_t inPos = 0;
+	int ret = Z_OK;
+	while(ret == Z_OK) {
+		if(zs.avail_in == 0 && inPos < raw.size()) {
+			size_t piece = qMin(raw.size() - inPos, zlibPiece);
+			zs.next_in = &raw[inPos];
+			zs.avail_in = uInt(piece);
+			inPos += piece;
+		}
+		if(zs.avail_out == 0) {
+			size_t done = zs.next_out - packed.data();
+			zs.avail_out = uInt(qMin(packed.size() - done, zlibPiece));
+			if(zs.avail_out == 0) {ret = Z_BUF_ERROR; break;}
+		}
+		bool allIn = (inPos == raw.size());
+		ret = deflate(&zs, !allIn ? Z_NO_FLUSH : (finish ? Z_FINISH : Z_SYNC_FLUSH));
+		if(allIn && !finish && ret == Z_OK && zs.avail_in == 0 && zs.avail_out != 0) {break;}
+	}
+	band.ok = finish ? (ret == Z_STREAM_END) : (ret == Z_OK);
+	packed.resize(zs.next_out - packed.data());
+	deflateEnd(&zs);
+	if(!band.ok) {return band;}
+
+	if(!png) {
+		band.data.swap(packed);
+		return band;
+	}
+
+	//PNG: the checksum of the uncompressed data, and the IDAT chunks
+	uLong a = adler32(0L, Z_NULL, 0);
+	for(size_t i = 0; i < raw.size(); i += zlibPiece) {
+		a = adler32(a, &raw[i], uInt(qMin(raw.size() - i, zlibPiece)));
+	}
+	band.adler = quint32(a);
+	for(size_t i = 0; i < packed.size(); i += zlibPiece) {
+		appendChunk(band.data, "IDAT", &packed[i], quint32(qMin(packed.size() - i, zlibPiece)));
+	}
+	return band;
+}
+
+bool gerbvQtImageWriter::writeData(const void* data, qint64 size) {
+	if(file.write(static_cast<const char*>(data), size) != size) {
+		cerr << "gerbvQtImageWriter: can't write " << file.fileName().toLocal8Bit().constData() << endl;
+		return false;
+	}
+	filePos += size;
+	return true;
+}
+
+bool gerbvQtImageWriter::writeChunk(const char* type, const uchar* data, quint32 size) {
+	std::vector<uchar> chunk;
+	appendChunk(chunk, type, data, size);
+	return writeData(chunk.data(), chunk.size());
+}
+
+bool gerbvQtImageWriter::writeEncoded(encodedBand band) {
+	if(!band.ok) {
+		cerr << "gerbvQtImageWriter: compression failed." << endl;
+		return false;
+	}
+	switch(params.format) {
+		case ff_PNG:
+			adler = quint32(adler32_combine(adler, band.adler, z_off_t(band.rawSize)));
+			break;
+		case ff_TIFF:
+			//Classic TIFF has 32-bit offsets
+			if(filePos + qint64(band.data.size()) > qint64(0xFFFFFFFFu)) {
+				cerr << "gerbvQtImageWriter: TIFF files are limited to 4 GB, use PNG." << endl;
+				return false;
+			}
+			stripOffsets.push_back(quint32(filePos));
+			stripSizes.push_back(quint32(band.data.size()));
+			break;
+		default:
+			break;
+	}
+	return writeData(band.data.data(), band.data.size());
+}
+
+bool gerbvQtImageWriter::close() {
+	if(!file.isOpen()) {return false;}
+
+	//Finish the encoding, in order
+	while(!pending.empty()) {
+		if(!writeEncoded(pending.front().get())) {failed = true;}
+		pending.pop_front();
+	}
+	if(!failed && rowsWritten != height) {
+		cerr << "gerbvQtImageWriter: only " << rowsWritten << " of " << height << " rows were written." << endl;
+		failed = true;
+	}
+
+	if(!failed && params.format == ff_PNG) {
+		std::vector<uchar> trailer;
+		putBE32(trailer, adler);
+		failed = !writeChunk("IDAT", trailer.data(), 4) || !writeChunk("IEND", NULL, 0);
+	}
+
+	if(!failed && params.format == ff_TIFF) {
+		if(filePos & 1) {
+			uchar pad = 0;
+			failed = !writeData(&pad, 1);
+		}
+		int spp = (params.layout == sl_RGB) ? 3 : (params.layout == sl_RGBA) ? 4 : 1;
+		int strips = int(stripOffsets.size());
+		int entries = (params.layout == sl_RGBA) ? 12 : 11;
+		quint32 ifdOffset = quint32(filePos);
+		quint32 extra = ifdOffset + 2 + 12*entries + 4;
+
+		//Values that don't fit into the entries go after the IFD
+		std::vector<uchar> ifd, data;
+		auto entry = [&](quint32 tag, quint32 type, quint32 count, quint32 value) {
+			putLE16(ifd, tag);
+			putLE16(ifd, type);
+			putLE32(ifd, count);
+			if(type == 3 && count == 1) {putLE16(ifd, value); putLE16(ifd, 0);}
+			else {putLE32(ifd, value);}
+		};
+		auto longArray = [&](const std::vector<quint32>& values) -> quint32 {
+			if(values.size() == 1) {return values[0];}
+			quint32 offset = extra + quint32(data.size());
+			for(size_t i = 0; i < values.size(); i++) {putLE32(data, values[i]);}
+			return offset;
+		};
+
+		putLE16(ifd, entries);
+		entry(256, 4, 1, params.width);				//ImageWidth
+		entry(257, 4, 1, height);				//ImageLength
+		if(spp > 2) {						//BitsPerSample
+			entry(258, 3, spp, extra + quint32(data.size()));
+			for(int i = 0; i < spp; i++) {putLE16(data, 8);}
+		} else {
+			entry(258, 3, 1, params.layout == sl_Bits ? 1 : 8);
+		}
+		entry(259, 3, 1, 8);					//Compression: Deflate
+		entry(262, 3, 1, photometric);				//PhotometricInterpretation
+		entry(273, 4, strips, longArray(stripOffsets));		//StripOffsets
+		entry(277, 3, 1, spp);					//SamplesPerPixel
+		entry(278, 4, 1, stripRows);				//RowsPerStrip
+		entry(279, 4, strips, longArray(stripSizes));		//StripByteCounts
+		entry(284, 3, 1, 1);					//PlanarConfiguration: contiguous
+		entry(317, 3, 1, 1);					//Predictor: none
+		if(params.layout == sl_RGBA) {entry(338, 3, 1, 2);}	//ExtraSamples: unassociated alpha
+		putLE32(ifd, 0);					//No next IFD
+
+		if(!failed) {failed = !writeData(ifd.data(), ifd.size()) || !writeData(data.data(), data.size());}
+		std::vector<uchar> offset;
+		putLE32(offset, ifdOffset);
+		if(!failed) {failed = !file.seek(4) || file.write(reinterpret_cast<const char*>(offset.data()), 4) != 4;}
+	}
+
+	file.close();
+	return !failed;
+}
@@ -0,0 +1,136 @@
+/*
+
+    This file is part of gerbvQt.
+    (c) Kurganov Alexander, 2016 me@sx107.ru
+
+    gerbvQt is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    Foobar is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with gerbvQt.  If not, see <http://www.gnu.org/licenses/>.
+
+*/
+
+
+#ifndef GERBVQTIMAGEWRITER
+#define GERBVQTIMAGEWRITER
+#include <QImage>
+#include <QFile>
+#include <QString>
+#include <QVector>
+#include <deque>
+#include <future>
+#include <vector>
+
+//Writes big images to PNG, TIFF or PBM files, encoding bands of rows in parallel.
+//
+//PNG: every band is compressed as an independent raw deflate stream, ended with Z_SYNC_FLUSH
+//(the last one with Z_FINISH), so the streams concatenate into one valid zlib stream.
+//The adler32 checksums of the bands are combined with adler32_combine.
+//TIFF: every band is a Deflate compressed strip. PBM (P4, 1bpp images only) is not compressed.
+//
+//Whole image:
+//	gerbvQtImageWriter::write(qtimage, "layer.png");
+//
+//Band by band, the bands are encoded while the next ones are rendered:
+//	gerbvQtImageWriter writer;
+//	writer.open("layer.tif", width, height, QImage::Format_Mono);
+//	for(...) {
+//		gqt.setDeviceOrigin(QPoint(0, y));
+//		gqt.renderImageToQt(&band, ...);
+//		writer.writeBand(band);
+//	}
+//	writer.close();
+class gerbvQtImageWriter {
+	public:
+		enum fileFormat {ff_Auto, ff_PNG, ff_TIFF, ff_PBM};
+
+		gerbvQtImageWriter();
+		~gerbvQtImageWriter();
+
+		//Writes the whole image in bands of bandRows rows (0 chooses them by the image size and the core count)
+		static bool write(	const QImage& image,
+					const QString& fileName,
+					fileFormat format = ff_Auto,
+					int level = 6,
+					int bandRows = 0);
+
+		//Starts a file. ff_Auto chooses the format by the file name extension.
+		//1bpp images are written with their color table (an empty one means white 0 and black 1),
+		//Format_Grayscale8/Alpha8 as 8-bit gray, Format_RGB32 as RGB and everything else as RGBA.
+		bool open(	const QString& fileName,
+				int width,
+				int height,
+				QImage::Format imageFormat,
+				const QVector<QRgb>& colorTable = QVector<QRgb>(),
+				fileFormat format = ff_Auto,
+				int level = 6);
+
+		//Appends the first "rows" rows of the band (all of them if rows < 0). The band must have the width given to open.
+		//For TIFF all the bands but the last one must have the same number of rows (the strip size).
+		//The band isn't copied: it is shared, so rendering into it again detaches it.
+		bool writeBand(const QImage& band, int rows = -1);
+
+		//Waits for the encoders and finishes the file. Returns false if anything failed.
+		bool close();
+
+		static fileFormat formatFromName(const QString& fileName);
+
+	private:
+		//Forbid copying
+		gerbvQtImageWriter(const gerbvQtImageWriter&);
+		gerbvQtImageWriter& operator=(const gerbvQtImageWriter&);
+
+		//How the pixels are stored in the file
+		enum sampleLayout {sl_Bits, sl_Gray, sl_RGB, sl_RGBA};
+
+		struct encodeParams {
+			fileFormat format;
+			sampleLayout layout;
+			int width;
+			int level;
+			bool invertBits;	//PBM: 1 is black
+			bool last;		//PNG: the last band ends the deflate stream
+		};
+
+		struct encodedBand {
+			bool ok;
+			std::vector<uchar> data;	//Ready to be written to the file
+			quint32 adler;			//PNG: adler32 of the uncompressed band
+			qint64 rawSize;
+		};
+
+		static encodedBand encode(QImage image, int y0, int rows, encodeParams p);
+		static void convertRow(const QImage& image, int y, sampleLayout layout, bool invertBits, uchar* out);
+		static int rowBytes(sampleLayout layout, int width);
+
+		bool writeRows(const QImage& image, int y0, int rows);
+		bool writeEncoded(encodedBand band);
+		bool writeData(const void* data, qint64 size);
+		bool writeChunk(const char* type, const uchar* data, quint32 size);
+
+		QFile file;
+		encodeParams params;
+		int height;
+		int rowsWritten;
+		int stripRows;
+		bool failed;
+
+		std::deque<std::future<encodedBand> > pending;
+		size_t maxPending;
+
+		quint32 adler;
+		std::vector<quint32> stripOffsets;
+		std::vector<quint32> stripSizes;
+		qint64 filePos;
+		int photometric;
+};
+
+#endif
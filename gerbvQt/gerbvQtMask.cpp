@@ -0,0 +1,278 @@
+/*
+
+    This file is part of gerbvQt.
+    (c) Kurganov Alexander, 2016 me@sx107.ru
+
+    gerbvQt is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    Foobar is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with gerbvQt.  If not, see <http://www.gnu.org/licenses/>.
+
+*/
+
+//Polarity masks (see gerbvQt::setPolarityMasks).
+//
+//Within a run of consecutive layers with the same polarity the drawing order doesn't matter:
+//the result is the union of the shapes, set to one color (or cleared). The run is drawn in dm_TwoColors
+//mode into a 1bpp mask of the device size, with all the usual fast 1bpp paths, and the box it was drawn
+//into is then written to the device with one pass. The mask is cleared in the same pass.
+//The box is the union of the conservative device bounds of the drawn nets.
+//The devices are 1bpp (dm_TwoColors), 8bpp coverage (dm_AlphaMask) and 32bpp QImages.
+
+#include "gerbvQt.h"
+#include <iostream>
+#include <cmath>
+#include <cstring>
+
+using namespace std;
+
+//Below this many pixels the mask is applied by the calling thread alone
+static const qint64 maskParallelPixels = 1 << 18;
+
+bool gerbvQt::prepareMask(QPaintDevice* device) {
+	maskActive = false;
+	if(!useMasks || spanImage == NULL || rhints.testFlag(QPainter::Antialiasing)) {return false;}
+
+	//The run's color must be written as a single bit or pixel value (see spansReady)
+	if(spanImage->depth() == 1 || spanImage->format() == QImage::Format_RGB32) {
+		//QPainter's Clear mode on Format_RGB32 can't be reproduced
+		if(dM != dm_TwoColors) {return false;}
+	}
+	if(spanImage->depth() == 8 && dM != dm_AlphaMask) {return false;}
+	if(spanImage->depth() == 32 && dM != dm_AlphaMask) {
+		if(fgColor.alpha() != 255 || (dM == dm_TwoColors && bgColor.alpha() != 255)) {return false;}
+	}
+
+	//A run of either polarity must be written as spans, endMask can't apply it otherwise
+	bool savedInvert = invertModes;
+	bool ready = true;
+	invertModes = false;
+	for(int m = 0; m < 2 && ready; m++) {
+		setMode(m == 0);
+		ready = spansReady();
+	}
+	invertModes = savedInvert;
+	if(!ready) {return false;}
+
+	//1bpp devices get a mask with their bit order, so it is applied byte by byte
+	QImage::Format format = (spanImage->depth() == 1) ? spanImage->format() : QImage::Format_Mono;
+	if(mask.size() != spanImage->size() || mask.format() != format) {
+		mask = QImage(spanImage->size(), format);
+		mask.setColor(0, qRgb(255, 255, 255));
+		mask.setColor(1, qRgb(0, 0, 0));
+	}
+	mask.fill(0);
+
+	//The same view as the device painter
+	maskPainter->begin(&mask);
+	maskPainter->setRenderHints(~rhints, false);
+	maskPainter->setRenderHints(rhints, true);
+	maskPainter->setViewTransformEnabled(true);
+	maskPainter->setWindow(QRect(origin, QSize(device->width(), device->height())));
+	maskPainter->setViewport(QRect(0, 0, device->width(), device->height()));
+	return true;
+}
+
+void gerbvQt::beginMask(bool inverted) {
+	deviceSaved.painter = painter;
+	deviceSaved.mode = dM;
+	deviceSaved.fg = fgColor;
+	deviceSaved.bg = bgColor;
+	deviceSaved.monoTarget = monoTarget;
+	deviceSaved.spanImage = spanImage;
+
+	maskPainter->setTransform(painter->transform());
+	painter = maskPainter;
+	dM = dm_TwoColors;
+	fgColor = Qt::black;
+	bgColor = Qt::white;
+	invertModes = false;
+
+	monoTarget = &mask;
+	spanImage = &mask;
+	monoColor = QColor();
+
+	maskInverted = inverted;
+	maskBox = QRect();
+	maskActive = true;
+}
+
+void gerbvQt::endMask(void) {
+	deviceSaved.painter->setTransform(painter->transform());
+	painter = deviceSaved.painter;
+	dM = deviceSaved.mode;
+	fgColor = deviceSaved.fg;
+	bgColor = deviceSaved.bg;
+	monoTarget = deviceSaved.monoTarget;
+	spanImage = deviceSaved.spanImage;
+	monoColor = QColor();
+	maskActive = false;
+
+	//The color of the run on the device
+	invertModes = maskInverted;
+	setMode(true);
+	QRect box = maskBox.intersected(mask.rect());
+	if(box.isEmpty()) {return;}
+	//prepareMask has checked both polarities
+	bool ready = spansReady();
+	Q_ASSERT(ready);
+
+	int depth = spanImage->depth();
+	bool set = spanBit;
+	uchar byte = spanByte;
+	quint32 pixel = spanPixel;
+	int width = spanImage->width();
+	int j0 = box.left() >> 3;
+	int j1 = box.right() >> 3;
+
+	//Not scanLine in the threads, it may detach the image
+	uchar* dst = spanImage->bits();
+	int dstBytes = spanImage->bytesPerLine();
+	uchar* src = mask.bits();
+	int srcBytes = mask.bytesPerLine();
+
+	auto apply = [&](int from, int to) {
+		for(int y = box.top() + from; y < box.top() + to; y++) {
+			uchar* m = src + qint64(y) * srcBytes;
+			uchar* d = dst + qint64(y) * dstBytes;
+			if(ready && depth == 1) {
+				for(int j = j0; j <= j1; j++) {d[j] = set ? uchar(d[j] | m[j]) : uchar(d[j] & ~m[j]);}
+			} else if(ready && depth == 8) {
+				for(int j = j0; j <= j1; j++) {
+					//Skip the empty words, fill the full bytes
+					if((j & 7) == 0 && j + 7 <= j1) {
+						quint64 w;
+						memcpy(&w, m + j, 8);
+						if(w == 0) {j += 7; continue;}
+					}
+					uchar b = m[j];
+					if(b == 0) {continue;}
+					int x = j*8;
+					if(b == 0xFF && x + 8 <= width) {
+						memset(d + x, byte, 8);
+						continue;
+					}
+					for(int k = 0; k < 8 && x + k < width; k++) {
+						if(b & (0x80 >> k)) {d[x + k] = byte;}
+					}
+				}
+			} else if(ready) {
+				quint32* px = reinterpret_cast<quint32*>(d);
+				for(int j = j0; j <= j1; j++) {
+					//Skip the empty words, fill the full bytes
+					if((j & 7) == 0 && j + 7 <= j1) {
+						quint64 w;
+						memcpy(&w, m + j, 8);
+						if(w == 0) {j += 7; continue;}
+					}
+					uchar b = m[j];
+					if(b == 0) {continue;}
+					int x = j*8;
+					if(b == 0xFF && x + 8 <= width) {
+						std::fill(px + x, px + x + 8, pixel);
+						continue;
+					}
+					for(int k = 0; k < 8 && x + k < width; k++) {
+						if(b & (0x80 >> k)) {px[x + k] = pixel;}
+					}
+				}
+			}
+			memset(m + j0, 0, j1 - j0 + 1);
+		}
+	};
+	if(qint64(box.width()) * box.height() < maskParallelPixels) {apply(0, box.height());}
+	else {parallelFor(box.height(), apply);}
+}
+
+void gerbvQt::addMaskBounds(const gerbv_image_t* gImage, const gerbv_net_t* cNet, const QPainterPath* region) {
+	//Net coordinates
+	QRectF r;
+	if(region) {
+		r = region->controlPointRect();
+	} else {
+		const gerbv_aperture_t* ap = gImage->aperture[cNet->aperture];
+		if(ap == NULL || cNet->aperture_state == GERBV_APERTURE_STATE_OFF) {return;}
+
+		//Distance of the farthest point of the aperture from its center
+		const double* par = ap->parameter;
+		double e;
+		switch(ap->type) {
+			case GERBV_APTYPE_CIRCLE: e = qMax(fabs(par[0]), fabs(par[1])) / 2.0; break;
+			case GERBV_APTYPE_RECTANGLE:
+			case GERBV_APTYPE_OVAL: e = hypot(par[0], par[1]) / 2.0; break;
+			case GERBV_APTYPE_POLYGON: e = fabs(par[0]) / 2.0; break;
+			case GERBV_APTYPE_MACRO: e = macroRadius(ap); break;
+			default: e = -1.0; break;
+		}
+		if(e < 0.0) {
+			maskBox = mask.rect();
+			return;
+		}
+
+		QPointF stop(cNet->stop_x, cNet->stop_y);
+		if(cNet->aperture_state == GERBV_APERTURE_STATE_FLASH) {
+			r = QRectF(stop, stop);
+		} else {
+			r = QRectF(QPointF(cNet->start_x, cNet->start_y), stop).normalized();
+			if(cNet->cirseg != NULL && (cNet->interpolation == GERBV_INTERPOLATION_CW_CIRCULAR || cNet->interpolation == GERBV_INTERPOLATION_CCW_CIRCULAR)) {
+				double rad = qMax(cNet->cirseg->width, cNet->cirseg->height) / 2.0;
+				r = r.united(QRectF(cNet->cirseg->cp_x - rad, cNet->cirseg->cp_y - rad, 2.0*rad, 2.0*rad));
+			}
+		}
+		r = r.adjusted(-e, -e, e, e);
+	}
+
+	//A pixel of margin for the rounding and the cosmetic lines
+	maskBox |= painter->combinedTransform().mapRect(r).toAlignedRect().adjusted(-1, -1, 1, 1);
+}
+
+double gerbvQt::macroRadius(const gerbv_aperture_t* ap) {
+	//The rotations are around the origin, so the distance bounds every rotated primitive
+	double r = 0.0;
+	for(const gerbv_simplified_amacro_t* mac = ap->simplified; mac != NULL; mac = mac->next) {
+		const double* par = mac->parameter;
+		switch(mac->type) {
+			case GERBV_APTYPE_MACRO_CIRCLE:
+				r = qMax(r, hypot(par[CIRCLE_CENTER_X], par[CIRCLE_CENTER_Y]) + fabs(par[CIRCLE_DIAMETER]) / 2.0);
+				break;
+			case GERBV_APTYPE_MACRO_OUTLINE:
+				for(int i = 0; i <= int(par[OUTLINE_NUMBER_OF_POINTS]); i++) {
+					r = qMax(r, hypot(par[OUTLINE_FIRST_X + i*2], par[OUTLINE_FIRST_Y + i*2]));
+				}
+				break;
+			case GERBV_APTYPE_MACRO_POLYGON:
+				r = qMax(r, hypot(par[POLYGON_CENTER_X], par[POLYGON_CENTER_Y]) + fabs(par[POLYGON_DIAMETER]) / 2.0);
+				break;
+			case GERBV_APTYPE_MACRO_MOIRE:
+				r = qMax(r, hypot(par[MOIRE_CENTER_X], par[MOIRE_CENTER_Y]) +
+						qMax(fabs(par[MOIRE_OUTSIDE_DIAMETER]) / 2.0, hypot(par[MOIRE_CROSSHAIR_LENGTH], par[MOIRE_CROSSHAIR_THICKNESS]) / 2.0));
+				break;
+			case GERBV_APTYPE_MACRO_THERMAL:
+				r = qMax(r, hypot(par[THERMAL_CENTER_X], par[THERMAL_CENTER_Y]) + fabs(par[THERMAL_OUTSIDE_DIAMETER]) / 2.0);
+				break;
+			case GERBV_APTYPE_MACRO_LINE20:
+				r = qMax(r, qMax(hypot(par[LINE20_START_X], par[LINE20_START_Y]), hypot(par[LINE20_END_X], par[LINE20_END_Y])) + fabs(par[LINE20_WIDTH]) / 2.0);
+				break;
+			case GERBV_APTYPE_MACRO_LINE21:
+				r = qMax(r, hypot(par[LINE21_CENTER_X], par[LINE21_CENTER_Y]) + hypot(par[LINE21_WIDTH], par[LINE21_HEIGHT]) / 2.0);
+				break;
+			case GERBV_APTYPE_MACRO_LINE22: {
+				double x = qMax(fabs(par[LINE22_LOWER_LEFT_X]), fabs(par[LINE22_LOWER_LEFT_X] + par[LINE22_WIDTH]));
+				double y = qMax(fabs(par[LINE22_LOWER_LEFT_Y]), fabs(par[LINE22_LOWER_LEFT_Y] + par[LINE22_HEIGHT]));
+				r = qMax(r, hypot(x, y));
+			}
+			break;
+			default:
+				return -1.0;
+		}
+	}
+	return r;
+}
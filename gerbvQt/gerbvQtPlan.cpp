@@ -0,0 +1,245 @@
+/*
+
+    This file is part of gerbvQt.
+    (c) Kurganov Alexander, 2016 me@sx107.ru
+
+    gerbvQt is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    Foobar is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with gerbvQt.  If not, see <http://www.gnu.org/licenses/>.
+
+*/
+
+//Render planner: chooses the rendering paths from the statistics of the image.
+
+#include "gerbvQt.h"
+#include <cmath>
+#include <QSet>
+
+using namespace std;
+
+//Maximal deviation of the macro circle polygons from the true circles, device pixels
+static const double planCircleTolerance = 0.25;
+
+gerbvQt::renderPlan gerbvQt::planRender(	const QPaintDevice * device,
+						const gerbv_image_t* gImage,
+						gerbv_user_transformation_t utransform,
+						const gerbv_render_info_t* renderInfo) {
+
+	gerbvQtImageNets nets(gImage);
+	return planNets(QSize(device->width(), device->height()), planFormat(device), gImage, nets, utransform, renderInfo);
+}
+
+QImage::Format gerbvQt::planFormat(const QPaintDevice * device) {
+	//Format_Invalid where the spans can't be written at all
+	if(device->devType() != QInternal::Image) {return QImage::Format_Invalid;}
+	const QImage* image = static_cast<const QImage*>(device);
+	if(image->depth() == 1 && image->colorCount() < 2) {return QImage::Format_Invalid;}
+	return image->format();
+}
+
+gerbvQt::renderPlan gerbvQt::planNets(	QSize deviceSize,
+					QImage::Format format,
+					const gerbv_image_t* gImage,
+					gerbvQtNetSource& nets,
+					const gerbv_user_transformation_t& utransform,
+					const gerbv_render_info_t* renderInfo) {
+
+	renderPlan p = renderPlan();
+
+	//1. The primitive mix
+	QHash<int, int> apertureUses;
+	QSet<const gerbv_layer_t*> layers;
+	const gerbv_layer_t* lastLayer = NULL;
+	const gerbv_layer_t* apertureLayer = NULL;
+	int lastAperture = -1;
+	for(const gerbv_net_t* cNet = nets.first(); cNet; cNet = nets.next()) {
+		p.nets++;
+		p.stepRepeatCopies += cNet->layer->stepAndRepeat.X * cNet->layer->stepAndRepeat.Y - 1;
+		if(cNet->layer != lastLayer) {
+			if(lastLayer == NULL || (lastLayer->polarity == GERBV_POLARITY_CLEAR) != (cNet->layer->polarity == GERBV_POLARITY_CLEAR)) {p.polarityRuns++;}
+			lastLayer = cNet->layer;
+		}
+		if(!layers.contains(cNet->layer)) {
+			layers.insert(cNet->layer);
+			if(cNet->layer->polarity == GERBV_POLARITY_CLEAR) {p.clearLayers++;}
+		}
+
+		if(cNet->interpolation == GERBV_INTERPOLATION_PAREA_START) {
+			p.regions++;
+			for(const gerbv_net_t* v = cNet->next; v != NULL && v->interpolation != GERBV_INTERPOLATION_PAREA_END; v = v->next) {
+				p.regionVertices++;
+			}
+			continue;
+		}
+
+		switch(cNet->aperture_state) {
+			case GERBV_APERTURE_STATE_FLASH: {
+				p.flashes++;
+				const gerbv_aperture_t* ap = gImage->aperture[cNet->aperture];
+				if(ap != NULL && ap->type == GERBV_APTYPE_MACRO) {p.macroFlashes++;}
+			}
+			break;
+			case GERBV_APERTURE_STATE_ON:
+				if(cNet->interpolation == GERBV_INTERPOLATION_CW_CIRCULAR || cNet->interpolation == GERBV_INTERPOLATION_CCW_CIRCULAR) {p.arcs++;}
+				else {p.tracks++;}
+				break;
+			default:
+				continue;
+		}
+		apertureUses[cNet->aperture]++;
+		if(cNet->layer == apertureLayer && cNet->aperture != lastAperture) {p.apertureSwitches++;}
+		apertureLayer = cNet->layer;
+		lastAperture = cNet->aperture;
+	}
+	p.layers = layers.size();
+	p.apertures = apertureUses.size();
+	p.apertureReuse = p.apertures ? double(p.flashes + p.tracks + p.arcs) / p.apertures : 0.0;
+
+	//2. Board size vs. device size
+	QTransform tr = imageTransform(gImage, utransform, renderInfo);
+	p.scale = sqrt(fabs(tr.determinant()));
+	QRectF board = tr.mapRect(QRectF(QPointF(gImage->info->min_x, gImage->info->min_y),
+					 QPointF(gImage->info->max_x, gImage->info->max_y)));
+	QRectF visible = board.intersected(QRectF(origin.x(), origin.y(), deviceSize.width(), deviceSize.height()));
+	double boardArea = board.width() * board.height();
+	p.visibleFraction = (boardArea > 0.0) ? visible.width() * visible.height() / boardArea : 1.0;
+
+	//3. The largest macro circle (they are drawn as polygons)
+	for(int i = 0; i < APERTURE_MAX; i++) {
+		const gerbv_aperture_t* ap = gImage->aperture[i];
+		if(ap == NULL || ap->type != GERBV_APTYPE_MACRO) {continue;}
+		for(const gerbv_simplified_amacro_t* mac = ap->simplified; mac != NULL; mac = mac->next) {
+			double d = 0.0;
+			switch(mac->type) {
+				case GERBV_APTYPE_MACRO_CIRCLE: d = mac->parameter[CIRCLE_DIAMETER]; break;
+				case GERBV_APTYPE_MACRO_MOIRE: d = mac->parameter[MOIRE_OUTSIDE_DIAMETER]; break;
+				case GERBV_APTYPE_MACRO_THERMAL: d = mac->parameter[THERMAL_OUTSIDE_DIAMETER]; break;
+				default: break;
+			}
+			p.maxMacroCircle = qMax(p.maxMacroCircle, fabs(d) / 2.0 * p.scale);
+		}
+	}
+
+	//4. Can the spans be written to the device?
+	if(!rhints.testFlag(QPainter::Antialiasing)) {
+		switch(format) {
+			case QImage::Format_Mono:
+			case QImage::Format_MonoLSB:
+				p.spanTarget = (dM == dm_TwoColors);
+				break;
+			case QImage::Format_Alpha8:
+			case QImage::Format_Grayscale8:
+				p.spanTarget = (dM == dm_AlphaMask);
+				break;
+			case QImage::Format_RGB32:
+			case QImage::Format_ARGB32:
+			case QImage::Format_ARGB32_Premultiplied:
+				p.spanTarget = (dM == dm_AlphaMask || (fgColor.alpha() == 255 && (dM != dm_TwoColors || bgColor.alpha() == 255)));
+				break;
+			default:
+				break;
+		}
+	}
+	bool mono = p.spanTarget && (format == QImage::Format_Mono || format == QImage::Format_MonoLSB);
+
+	//Decisions.
+	//Sprites pay off when the same flashes repeat: their rasterization is cached per aperture and phase.
+	p.flashSprites = mono && p.flashes > 0 && p.apertureReuse >= 4.0;
+
+	//The analytic kernels are always faster than stroking, when they can be used.
+	//The rectangle tracks lose QPainter's outline, so they are only kept when they were turned on (setAnalyticStrokes).
+	p.analyticStrokes = useAnalytic && p.spanTarget && (p.tracks + p.arcs) > 0;
+
+	//The fixed point pipeline culls the nets outside of the device (small viewports, S&R copies)
+	//and fills the regions without QPainter's path conversions
+	p.fixedPoint = p.spanTarget && (p.visibleFraction < 0.5 || (p.stepRepeatCopies > 0 && p.visibleFraction < 1.0) || p.regionVertices > p.nets);
+
+	//Clear primitives on 8/32bpp devices are QPainter Clear draws, and every polarity change switches the modes:
+	//the runs are cheaper in the 1bpp masks
+	p.polarityMasks = p.spanTarget && !mono && p.polarityRuns > 1;
+	
+	//Sorting the nets of the layers pays off when the file keeps switching the apertures
+	p.reorderNets = orderIndependent() && p.nets >= 1024 && p.apertureSwitches * 4 > p.nets;
+	
+	//Enough polygon sides for the largest macro circle: the sagitta r*(1 - cos(pi/n)) within the tolerance
+	p.macroCirclePrecision = GERBVQT_MACRO_CIRCLE_PRECISION;
+	if(p.maxMacroCircle > planCircleTolerance) {
+		double n = ceil(M_PI / acos(1.0 - planCircleTolerance / p.maxMacroCircle));
+		p.macroCirclePrecision = int(qBound(12.0, n, 1024.0));
+	} else if(p.maxMacroCircle > 0.0) {
+		p.macroCirclePrecision = 12;
+	}
+
+	plan = p;
+	return p;
+}
+
+void gerbvQt::applyPlan(const renderPlan& _plan) {
+	useSprites = _plan.flashSprites;
+	useAnalytic = _plan.analyticStrokes;
+	useFixed = _plan.fixedPoint;
+	useMasks = _plan.polarityMasks;
+	useReorder = _plan.reorderNets;
+	macroPrecision = qMax(3, _plan.macroCirclePrecision);
+	plan = _plan;
+}
+
+void gerbvQt::applyAutoPlan(const renderPlan& _plan) {
+	//The explicit settings win over the plan
+	if(!(userSettings & us_Sprites)) {useSprites = _plan.flashSprites;}
+	if(!(userSettings & us_Analytic)) {useAnalytic = _plan.analyticStrokes;}
+	if(!(userSettings & us_Fixed)) {useFixed = _plan.fixedPoint;}
+	if(!(userSettings & us_Masks)) {useMasks = _plan.polarityMasks;}
+	if(!(userSettings & us_Reorder)) {useReorder = _plan.reorderNets;}
+	if(!(userSettings & us_MacroPrecision)) {macroPrecision = qMax(3, _plan.macroCirclePrecision);}
+	plan = _plan;
+}
+
+void gerbvQt::beginRender(void) {
+	renderDepth++;
+}
+
+void gerbvQt::autoPlan(	QSize deviceSize,
+			QImage::Format format,
+			const gerbv_image_t* gImage,
+			gerbvQtNetSource& nets,
+			const gerbv_user_transformation_t& utransform,
+			const gerbv_render_info_t* renderInfo) {
+	//Only the first call of the outermost render plans: the bands and the nested renders don't
+	if(renderDepth != 1 || planTried) {return;}
+	planTried = true;
+	if(!useAutoPlan || !nets.canRestart()) {return;}
+
+	autoSaved.sprites = useSprites;
+	autoSaved.analytic = useAnalytic;
+	autoSaved.fixed = useFixed;
+	autoSaved.masks = useMasks;
+	autoSaved.reorder = useReorder;
+	autoSaved.macroPrecision = macroPrecision;
+	autoRestore = true;
+	applyAutoPlan(planNets(deviceSize, format, gImage, nets, utransform, renderInfo));
+}
+
+void gerbvQt::endRender(void) {
+	if(--renderDepth > 0) {return;}
+	planTried = false;
+	if(!autoRestore) {return;}
+
+	//The planned settings are only for this render
+	useSprites = autoSaved.sprites;
+	useAnalytic = autoSaved.analytic;
+	useFixed = autoSaved.fixed;
+	useMasks = autoSaved.masks;
+	useReorder = autoSaved.reorder;
+	macroPrecision = autoSaved.macroPrecision;
+	autoRestore = false;
+}
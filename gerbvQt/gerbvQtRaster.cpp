@@ -0,0 +1,528 @@
+/*
+
+    This file is part of gerbvQt.
+    (c) Kurganov Alexander, 2016 me@sx107.ru
+
+    gerbvQt is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    Foobar is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with gerbvQt.  If not, see <http://www.gnu.org/licenses/>.
+
+*/
+
+//Direct rasterization into QImage devices, bypassing QPainter where it is too slow.
+
+#include "gerbvQt.h"
+#include <cmath>
+#include <cstring>
+#include <algorithm>
+
+using namespace std;
+
+//Reverses the bit order of a byte (Format_Mono <-> Format_MonoLSB)
+static inline uchar reverseBits(uchar b) {
+	b = uchar((b & 0xF0) >> 4 | (b & 0x0F) << 4);
+	b = uchar((b & 0xCC) >> 2 | (b & 0x33) << 2);
+	b = uchar((b & 0xAA) >> 1 | (b & 0x55) << 1);
+	return b;
+}
+
+void gerbvQt::prepareSpanTarget(QPaintDevice* device) {
+	monoTarget = NULL;
+	spanImage = NULL;
+	spriteCache.clear();
+	monoColor = QColor();
+
+	if(device->devType() != QInternal::Image) {return;}
+	QImage* image = static_cast<QImage*>(device);
+	switch(image->format()) {
+		case QImage::Format_RGB32:
+		case QImage::Format_ARGB32:
+		case QImage::Format_ARGB32_Premultiplied:
+		case QImage::Format_Alpha8:
+		case QImage::Format_Grayscale8:
+			spanImage = image;
+			return;
+		case QImage::Format_Mono:
+		case QImage::Format_MonoLSB:
+			break;
+		default:
+			return;
+	}
+
+	//Without the color table QPainter dithers, we can't reproduce that
+	if(image->colorCount() < 2) {return;}
+	monoTarget = image;
+	spanImage = image;
+}
+
+uint gerbvQt::monoIndex(const QColor& _color) {
+	//Let QPainter decide which index the color is mapped to
+	if(_color != monoColor) {
+		QImage probe(1, 1, monoTarget->format());
+		probe.setColorTable(monoTarget->colorTable());
+		probe.fill(0);
+		QPainter p(&probe);
+		p.fillRect(0, 0, 1, 1, _color);
+		p.end();
+		monoColor = _color;
+		monoColorIndex = probe.pixelIndex(0, 0);
+	}
+	return monoColorIndex;
+}
+
+bool gerbvQt::drawSpriteFlash(const QPointF& point, const gerbv_aperture_t* ap) {
+	//Drill and via layers consist mostly of thousands of identical flashes.
+	//A flash is rasterized by QPainter itself into a small 1bpp sprite at its exact sub-pixel phase,
+	//so the sprite holds the very pixels QPainter would draw there, moved by whole pixels.
+	//The sprite is then ORed (or AND-NOTed) into the device scanlines at the integer device position
+	//of every later flash of the aperture with the same phase.
+	//The first flash of a phase is drawn with QPainter as usual: the sprite is only built when the phase repeats.
+
+	if(!useSprites || monoTarget == NULL || dM != dm_TwoColors) {return false;}
+	if(rhints.testFlag(QPainter::Antialiasing)) {return false;}
+	//The fixed point rasterizer draws the flashes itself
+	if(useFixed) {return false;}
+
+	const QTransform& tr = painter->transform();
+	if(tr.type() > QTransform::TxScale) {return false;}
+
+	//Half size of the sprite in device pixels
+	double hw, hh;
+	switch(ap->type) {
+		case GERBV_APTYPE_CIRCLE: hw = hh = ap->parameter[0] / 2.0; break;
+		case GERBV_APTYPE_RECTANGLE: hw = ap->parameter[0] / 2.0; hh = ap->parameter[1] / 2.0; break;
+		default: return false;
+	}
+	hw *= fabs(tr.m11());
+	hh *= fabs(tr.m22());
+	if(2.0*hw > GERBVQT_SPRITE_MAX_SIZE || 2.0*hh > GERBVQT_SPRITE_MAX_SIZE) {return false;}
+
+	//Position in the full picture: integer part and the exact sub-pixel phase.
+	//The world transform doesn't contain the device origin, so the phase doesn't depend on it.
+	QPointF dp = tr.map(point);
+	double fx = floor(dp.x());
+	double fy = floor(dp.y());
+	QPair<double, double> phase(dp.x() - fx, dp.y() - fy);
+	int ix = int(fx);
+	int iy = int(fy);
+
+	int mx = int(ceil(hw)) + 1;
+	int my = int(ceil(hh)) + 1;
+
+	//Sprites are valid only for one scale
+	spriteSet& set = spriteCache[ap];
+	if(set.sprites.isEmpty() || set.scaleX != tr.m11() || set.scaleY != tr.m22()) {
+		set.scaleX = tr.m11();
+		set.scaleY = tr.m22();
+		set.sprites.clear();
+	}
+
+	QHash<QPair<double, double>, QImage>::iterator it = set.sprites.find(phase);
+	if(it == set.sprites.end()) {
+		//Not cached: QPainter draws this one, the sprite is built if the phase comes again
+		if(set.sprites.size() < GERBVQT_SPRITE_PHASES) {set.sprites.insert(phase, QImage());}
+		return false;
+	}
+
+	QImage& sprite = it.value();
+	if(sprite.isNull()) {
+		sprite = QImage(2*mx + 1, 2*my + 1, QImage::Format_Mono);
+		sprite.setColor(0, qRgb(255, 255, 255));
+		sprite.setColor(1, qRgb(0, 0, 0));
+		sprite.fill(0);
+
+		//The same path and scale as on the device, only the translation differs by whole pixels
+		QPainterPath f;
+		if(ap->type == GERBV_APTYPE_CIRCLE) {generateCircleFlashPath(f, point, ap);}
+		else {generateRectFlashPath(f, point, ap);}
+
+		QTransform spriteTransform(tr.m11(), 0.0, 0.0, tr.m22(), tr.dx() - ix + mx, tr.dy() - iy + my);
+
+		QPainter spritePainter(&sprite);
+		spritePainter.setRenderHints(rhints, true);
+		spritePainter.setTransform(spriteTransform);
+		spritePainter.fillPath(f, QBrush(Qt::black));
+		spritePainter.end();
+	}
+
+	stampMono(sprite, ix - origin.x() - mx, iy - origin.y() - my, monoIndex(color) != 0);
+	return true;
+}
+
+void gerbvQt::stampMono(const QImage& mask, int dx, int dy, bool set) {
+	//Copies the set bits of the Format_Mono mask to monoTarget at (dx, dy).
+	//Set bits become 1 if "set" is true, and 0 otherwise; cleared bits of the mask are left untouched.
+	bool lsb = (monoTarget->format() == QImage::Format_MonoLSB);
+	int targetBytes = (monoTarget->width() + 7) / 8;
+	int maskBytes = (mask.width() + 7) / 8;
+
+	//Byte offset and bit shift (floor for the negative coordinates)
+	int bx = dx >> 3;
+	int shift = dx - bx*8;
+
+	int rowFrom = qMax(0, -dy);
+	int rowTo = qMin(mask.height(), monoTarget->height() - dy);
+	for(int r = rowFrom; r < rowTo; r++) {
+		const uchar* src = mask.constScanLine(r);
+		uchar* dst = monoTarget->scanLine(dy + r);
+
+		int kFrom = qMax(0, -bx);
+		int kTo = qMin(maskBytes + 1, targetBytes - bx);
+		for(int k = kFrom; k < kTo; k++) {
+			uint v = 0;
+			if(k < maskBytes) {v |= src[k] >> shift;}
+			if(k > 0 && shift != 0) {v |= uint(src[k - 1]) << (8 - shift);}
+			uchar b = uchar(v);
+			if(b == 0) {continue;}
+			if(lsb) {b = reverseBits(b);}
+
+			if(set) {dst[bx + k] |= b;}
+			else {dst[bx + k] &= uchar(~b);}
+		}
+	}
+}
+
+void gerbvQt::copyMono(QImage& dst, const QImage& src, const QPoint& pos) {
+	//Copies all the pixels of src (1bpp, the same format as dst) to dst at pos.
+	//The bytes are assembled like in stampMono, the partial bytes on the edges are masked.
+	bool lsb = (dst.format() == QImage::Format_MonoLSB);
+	int x0 = qMax(0, pos.x());
+	int x1 = qMin(dst.width(), pos.x() + src.width());
+	int y0 = qMax(0, pos.y());
+	int y1 = qMin(dst.height(), pos.y() + src.height());
+	if(x0 >= x1 || y0 >= y1) {return;}
+
+	int srcBytes = (src.width() + 7) / 8;
+	int bx = pos.x() >> 3;
+	int shift = pos.x() - bx*8;
+	for(int y = y0; y < y1; y++) {
+		const uchar* s = src.constScanLine(y - pos.y());
+		uchar* d = dst.scanLine(y);
+		for(int j = x0 >> 3; j <= (x1 - 1) >> 3; j++) {
+			int k = j - bx;
+			uint v = 0;
+			if(k >= 0 && k < srcBytes) {v |= uint(lsb ? reverseBits(s[k]) : s[k]) >> shift;}
+			if(k > 0 && k <= srcBytes && shift != 0) {v |= uint(lsb ? reverseBits(s[k - 1]) : s[k - 1]) << (8 - shift);}
+
+			int a = qMax(x0, j*8) - j*8;
+			int b = qMin(x1, j*8 + 8) - j*8;
+			uchar mask = uchar((0xFF >> a) & (0xFF << (8 - b)));
+			uchar bits = uchar(v);
+			if(lsb) {mask = reverseBits(mask); bits = reverseBits(bits);}
+			d[j] = uchar((d[j] & ~mask) | (bits & mask));
+		}
+	}
+}
+
+//Spans
+
+bool gerbvQt::spansReady(void) {
+	//Spans can be written only if the result is the same as QPainter's aliased drawing:
+	//a single bit value, or an opaque pixel value, or the fully transparent pixel for the clear mode.
+	if(spanImage == NULL || rhints.testFlag(QPainter::Antialiasing)) {return false;}
+	switch(spanImage->format()) {
+		case QImage::Format_Mono:
+		case QImage::Format_MonoLSB:
+			if(dM != dm_TwoColors) {return false;}
+			spanBit = (monoIndex(color) != 0);
+			return true;
+		case QImage::Format_Alpha8:
+		case QImage::Format_Grayscale8:
+			//The coverage: 255 for the dark shapes, 0 for the clear ones
+			if(dM != dm_AlphaMask) {return false;}
+			spanByte = (painter->compositionMode() == QPainter::CompositionMode_Clear) ? 0 : 255;
+			return true;
+		case QImage::Format_RGB32:
+		case QImage::Format_ARGB32:
+		case QImage::Format_ARGB32_Premultiplied:
+			if(dM != dm_TwoColors && painter->compositionMode() == QPainter::CompositionMode_Clear) {
+				if(spanImage->format() == QImage::Format_RGB32) {return false;}
+				spanPixel = 0;
+				return true;
+			}
+			if(color.alpha() != 255) {return false;}
+			spanPixel = color.rgba();
+			return true;
+		default:
+			return false;
+	}
+}
+
+//Sets or clears the bits [x0, x1) of a 1bpp scanline
+static void fillBits(uchar* line, int x0, int x1, bool lsb, bool set) {
+	int b0 = x0 >> 3;
+	int b1 = (x1 - 1) >> 3;
+	uchar m0 = lsb ? uchar(0xFF << (x0 & 7)) : uchar(0xFF >> (x0 & 7));
+	uchar m1 = lsb ? uchar(0xFF >> (7 - ((x1 - 1) & 7))) : uchar(0xFF << (7 - ((x1 - 1) & 7)));
+	if(b0 == b1) {m0 &= m1;}
+
+	if(set) {line[b0] |= m0;}
+	else {line[b0] &= uchar(~m0);}
+	if(b0 == b1) {return;}
+
+	if(b1 - b0 > 1) {memset(line + b0 + 1, set ? 0xFF : 0x00, b1 - b0 - 1);}
+	if(set) {line[b1] |= m1;}
+	else {line[b1] &= uchar(~m1);}
+}
+
+void gerbvQt::fillSpan(int y, int x0, int x1) {
+	//Fills the pixels [x0, x1) of the row y, clipped to the device
+	if(y < 0 || y >= spanImage->height()) {return;}
+	x0 = qMax(x0, 0);
+	x1 = qMin(x1, spanImage->width());
+	if(x0 >= x1) {return;}
+
+	if(spanImage->depth() == 1) {
+		fillBits(spanImage->scanLine(y), x0, x1, spanImage->format() == QImage::Format_MonoLSB, spanBit);
+	} else if(spanImage->depth() == 8) {
+		memset(spanImage->scanLine(y) + x0, spanByte, x1 - x0);
+	} else {
+		quint32* line = reinterpret_cast<quint32*>(spanImage->scanLine(y));
+		std::fill(line + x0, line + x1, spanPixel);
+	}
+}
+
+bool gerbvQt::deviceScale(double& scale) {
+	//The analytic kernels need the circles to stay circles:
+	//no shear, no projection and the same scale on both axes (rotations and mirrors are fine)
+	const QTransform& tr = painter->transform();
+	if(!tr.isAffine()) {return false;}
+	double sx = tr.m11()*tr.m11() + tr.m12()*tr.m12();
+	double sy = tr.m21()*tr.m21() + tr.m22()*tr.m22();
+	double skew = tr.m11()*tr.m21() + tr.m12()*tr.m22();
+	if(fabs(sx - sy) > 1e-9 * sx || fabs(skew) > 1e-9 * sx) {return false;}
+	scale = sqrt(sx);
+	return scale > 0.0;
+}
+
+//Analytic kernels
+
+void gerbvQt::fillDisc(const QPointF& center, double radius) {
+	//Pixels with the centers inside the circle
+	int yFrom = int(ceil(center.y() - radius - 0.5));
+	int yTo = int(floor(center.y() + radius - 0.5));
+	yFrom = qMax(yFrom, 0);
+	yTo = qMin(yTo, spanImage->height() - 1);
+	for(int y = yFrom; y <= yTo; y++) {
+		double dy = y + 0.5 - center.y();
+		double h2 = radius*radius - dy*dy;
+		if(h2 < 0.0) {continue;}
+		double h = sqrt(h2);
+		fillSpan(y, int(ceil(center.x() - h - 0.5)), int(floor(center.x() + h - 0.5)) + 1);
+	}
+}
+
+bool gerbvQt::drawCapsule(const QPointF& start, const QPointF& stop, double width) {
+	//A track of a circle aperture is the set of the points closer than width/2 to the segment.
+	//Every row of it is a single interval: the convex hull of the row's intersections
+	//with the two end discs and with the rectangle between them.
+	//Zero width tracks are cosmetic 1px lines in QPainter, these are left to it.
+	double scale;
+	if((!useAnalytic && !useFixed) || width <= 0.0 || !deviceScale(scale) || !spansReady()) {return false;}
+	if(useFixed) {return fixedCapsule(start, stop, width / 2.0 * scale);}
+
+	const QTransform tr = painter->combinedTransform();
+	QPointF a = tr.map(start);
+	QPointF b = tr.map(stop);
+	double r = width / 2.0 * scale;
+
+	double dx = b.x() - a.x();
+	double dy = b.y() - a.y();
+	double len2 = dx*dx + dy*dy;
+	if(len2 == 0.0) {
+		fillDisc(a, r);
+		return true;
+	}
+	double rl = r * sqrt(len2);
+
+	int yFrom = qMax(0, int(ceil(qMin(a.y(), b.y()) - r - 0.5)));
+	int yTo = qMin(spanImage->height() - 1, int(floor(qMax(a.y(), b.y()) + r - 0.5)));
+
+	for(int y = yFrom; y <= yTo; y++) {
+		double yc = y + 0.5;
+		double xl = 1e300;
+		double xr = -1e300;
+
+		//End discs
+		for(int i = 0; i < 2; i++) {
+			const QPointF& c = i ? b : a;
+			double h2 = r*r - (yc - c.y())*(yc - c.y());
+			if(h2 < 0.0) {continue;}
+			double h = sqrt(h2);
+			xl = qMin(xl, c.x() - h);
+			xr = qMax(xr, c.x() + h);
+		}
+
+		//The rectangle: |cross(d, p - a)| <= r*|d| and 0 <= dot(d, p - a) <= |d|^2
+		double ey = yc - a.y();
+		double rl0 = -1e300, rl1 = 1e300;
+		bool inside = true;
+		if(dy != 0.0) {
+			double u = a.x() + (dx*ey - rl) / dy;
+			double v = a.x() + (dx*ey + rl) / dy;
+			rl0 = qMax(rl0, qMin(u, v));
+			rl1 = qMin(rl1, qMax(u, v));
+		} else if(fabs(dx*ey) > rl) {inside = false;}
+		if(dx != 0.0) {
+			double u = a.x() - dy*ey / dx;
+			double v = a.x() + (len2 - dy*ey) / dx;
+			rl0 = qMax(rl0, qMin(u, v));
+			rl1 = qMin(rl1, qMax(u, v));
+		} else if(dy*ey < 0.0 || dy*ey > len2) {inside = false;}
+		if(inside && rl0 <= rl1) {
+			xl = qMin(xl, rl0);
+			xr = qMax(xr, rl1);
+		}
+
+		if(xl > xr) {continue;}
+		fillSpan(y, int(ceil(xl - 0.5)), int(floor(xr - 0.5)) + 1);
+	}
+	return true;
+}
+
+bool gerbvQt::drawConvexPolygon(const QPointF* points, int numPoints) {
+	//The sweep of a rectangle aperture is a convex hexagon, so every row is a single interval.
+	//Note: QPainter also outlines it with the cosmetic pen, which may add a pixel on the edges.
+	//The outline isn't drawn here, that's why setAnalyticStrokes is off by default.
+	double scale;
+	if((!useAnalytic && !useFixed) || numPoints > 8 || !deviceScale(scale) || !spansReady()) {return false;}
+	if(useFixed) {return fixedPolygon(points, numPoints);}
+
+	const QTransform tr = painter->combinedTransform();
+	QPointF dev[8];
+	double yMin = 1e300, yMax = -1e300;
+	for(int i = 0; i < numPoints; i++) {
+		dev[i] = tr.map(points[i]);
+		yMin = qMin(yMin, dev[i].y());
+		yMax = qMax(yMax, dev[i].y());
+	}
+
+	int yFrom = qMax(0, int(ceil(yMin - 0.5)));
+	int yTo = qMin(spanImage->height() - 1, int(ceil(yMax - 0.5)) - 1);
+	for(int y = yFrom; y <= yTo; y++) {
+		double yc = y + 0.5;
+		double xl = 1e300, xr = -1e300;
+		for(int i = 0; i < numPoints; i++) {
+			const QPointF& p = dev[i];
+			const QPointF& q = dev[(i + 1) % numPoints];
+			if((yc < p.y()) == (yc < q.y())) {continue;}
+			double x = p.x() + (yc - p.y()) * (q.x() - p.x()) / (q.y() - p.y());
+			xl = qMin(xl, x);
+			xr = qMax(xr, x);
+		}
+		if(xl > xr) {continue;}
+		fillSpan(y, int(ceil(xl - 0.5)), int(ceil(xr - 0.5)));
+	}
+	return true;
+}
+
+bool gerbvQt::drawArcCapsule(const gerbv_net_t* cNet, double width) {
+	//The stroke of an arc with a circle aperture: the annular sector plus the two end discs.
+	//The sector ends are taken from QPainterPath::arcMoveTo, so the arc is exactly the one
+	//generateArcPath makes. Inside the annulus the pixels are tested against the two sector rays.
+	double scale;
+	if((!useAnalytic && !useFixed) || width <= 0.0 || !deviceScale(scale) || !spansReady()) {return false;}
+	if(cNet->cirseg == NULL || cNet->cirseg->width != cNet->cirseg->height) {return false;}
+
+	double ang1 = cNet->cirseg->angle1;
+	double ang2 = cNet->cirseg->angle2;
+	double startAngle = (cNet->interpolation == GERBV_INTERPOLATION_CW_CIRCULAR) ? ang2 : ang1;
+	double sweep = fabs(ang2 - ang1);
+
+	QPointF center(cNet->cirseg->cp_x, cNet->cirseg->cp_y);
+	double radius = fabs(cNet->cirseg->width) / 2.0;
+	QRectF arcRect(center - QPointF(radius, radius), center + QPointF(radius, radius));
+
+	QPointF ends[3];
+	QPainterPath probe;
+	probe.arcMoveTo(arcRect, startAngle);
+	ends[0] = probe.currentPosition();
+	probe.arcMoveTo(arcRect, startAngle + sweep);
+	ends[1] = probe.currentPosition();
+	probe.arcMoveTo(arcRect, startAngle + sweep / 2.0);
+	ends[2] = probe.currentPosition();
+
+	double hw = width / 2.0 * scale;
+	double R = radius * scale;
+	if(useFixed) {return fixedArc(center, ends, R, hw, sweep);}
+
+	const QTransform tr = painter->combinedTransform();
+	QPointF s = tr.map(ends[0]);
+	QPointF e = tr.map(ends[1]);
+	QPointF m = tr.map(ends[2]);
+	QPointF c = tr.map(center);
+	double rOut = R + hw;
+	double rIn = qMax(0.0, R - hw);
+
+	//Sector test (in the device orientation of the arc)
+	double sx = s.x() - c.x(), sy = s.y() - c.y();
+	double ex = e.x() - c.x(), ey = e.y() - c.y();
+	double o = (sx*(m.y() - c.y()) - sy*(m.x() - c.x())) < 0.0 ? -1.0 : 1.0;
+	bool full = (sweep >= 360.0);
+	bool wide = (sweep > 180.0);
+	auto inSector = [&](double px, double py) {
+		if(full) {return true;}
+		double cs = o * (sx*py - sy*px);
+		double ce = o * (px*ey - py*ex);
+		if(wide) {return cs >= 0.0 || ce >= 0.0;}
+		return cs >= 0.0 && ce >= 0.0;
+	};
+
+	//Bounding box: the end discs and the extreme points of the circle that are on the arc
+	double bx0 = qMin(s.x(), e.x()) - hw, bx1 = qMax(s.x(), e.x()) + hw;
+	double by0 = qMin(s.y(), e.y()) - hw, by1 = qMax(s.y(), e.y()) + hw;
+	const double ext[4][2] = {{R, 0}, {-R, 0}, {0, R}, {0, -R}};
+	for(int i = 0; i < 4; i++) {
+		if(!inSector(ext[i][0], ext[i][1])) {continue;}
+		bx0 = qMin(bx0, c.x() + ext[i][0] - hw);
+		bx1 = qMax(bx1, c.x() + ext[i][0] + hw);
+		by0 = qMin(by0, c.y() + ext[i][1] - hw);
+		by1 = qMax(by1, c.y() + ext[i][1] + hw);
+	}
+
+	int yFrom = qMax(0, int(ceil(by0 - 0.5)));
+	int yTo = qMin(spanImage->height() - 1, int(floor(by1 - 0.5)));
+	int xMin = qMax(0, int(ceil(bx0 - 0.5)));
+	int xMax = qMin(spanImage->width() - 1, int(floor(bx1 - 0.5)));
+
+	for(int y = yFrom; y <= yTo; y++) {
+		double py = y + 0.5 - c.y();
+		double ho2 = rOut*rOut - py*py;
+		if(ho2 < 0.0) {continue;}
+		double ho = sqrt(ho2);
+		double hi2 = rIn*rIn - py*py;
+		double hi = hi2 > 0.0 ? sqrt(hi2) : -1.0;
+
+		//One or two intervals of the annulus on this row
+		double iv[2][2] = {{c.x() - ho, hi >= 0.0 ? c.x() - hi : c.x() + ho}, {c.x() + hi, c.x() + ho}};
+		int intervals = hi >= 0.0 ? 2 : 1;
+		for(int k = 0; k < intervals; k++) {
+			int x0 = qMax(xMin, int(ceil(iv[k][0] - 0.5)));
+			int x1 = qMin(xMax, int(floor(iv[k][1] - 0.5)));
+			int runStart = -1;
+			for(int x = x0; x <= x1; x++) {
+				if(inSector(x + 0.5 - c.x(), py)) {
+					if(runStart < 0) {runStart = x;}
+				} else if(runStart >= 0) {
+					fillSpan(y, runStart, x);
+					runStart = -1;
+				}
+			}
+			if(runStart >= 0) {fillSpan(y, runStart, x1 + 1);}
+		}
+	}
+
+	//Round caps
+	fillDisc(s, hw);
+	fillDisc(e, hw);
+	return true;
+}
@@ -0,0 +1,116 @@
+/*
+
+    This file is part of gerbvQt.
+    (c) Kurganov Alexander, 2016 me@sx107.ru
+
+    gerbvQt is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    Foobar is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with gerbvQt.  If not, see <http://www.gnu.org/licenses/>.
+
+*/
+
+//Net reordering (see gerbvQt::setReorderNets).
+//
+//CAM tools write the nets in an order that jumps around the board and alternates the apertures.
+//Within one layer (a run of nets between two %LP commands) the order doesn't matter for aliased
+//opaque drawing, so the nets of every layer are sorted: by the netstate (every change of it resets
+//the painter transform), by the aperture, then by the Morton order of the grid cell of their position.
+
+#include "gerbvQt.h"
+#include <algorithm>
+
+using namespace std;
+
+bool gerbvQt::orderIndependent(void) {
+	//Every pixel ends up with the layer's color if any net of the layer covers it,
+	//whatever the order is. Blending (antialiasing, translucent colors) depends on the order.
+	if(rhints.testFlag(QPainter::Antialiasing)) {return false;}
+	//dm_AlphaMask draws the full coverage whatever the colors are
+	if(dM == dm_AlphaMask) {return true;}
+	if(fgColor.alpha() != 255) {return false;}
+	if(dM == dm_TwoColors && bgColor.alpha() != 255) {return false;}
+	return true;
+}
+
+quint32 gerbvQtSortedNets::mortonKey(quint32 x, quint32 y) {
+	//Interleaves the bits of two 16-bit values, x in the even bits
+	x = (x | (x << 8)) & 0x00FF00FFu;
+	x = (x | (x << 4)) & 0x0F0F0F0Fu;
+	x = (x | (x << 2)) & 0x33333333u;
+	x = (x | (x << 1)) & 0x55555555u;
+	y = (y | (y << 8)) & 0x00FF00FFu;
+	y = (y | (y << 4)) & 0x0F0F0F0Fu;
+	y = (y | (y << 2)) & 0x33333333u;
+	y = (y | (y << 1)) & 0x55555555u;
+	return x | (y << 1);
+}
+
+gerbvQtSortedNets::gerbvQtSortedNets(const gerbv_image_t* gImage, gerbvQtNetSource& source) : index(0) {
+	for(const gerbv_net_t* cNet = source.first(); cNet; cNet = source.next()) {order.push_back(cNet);}
+
+	//The grid over the image box
+	double x0 = gImage->info->min_x;
+	double y0 = gImage->info->min_y;
+	double cellX = qMax(gImage->info->max_x - x0, 1e-9) / GERBVQT_REORDER_GRID;
+	double cellY = qMax(gImage->info->max_y - y0, 1e-9) / GERBVQT_REORDER_GRID;
+
+	//Key: netstate rank (16 bits) | aperture (16 bits) | Morton code of the cell (32 bits)
+	struct sortEntry {
+		quint64 key;
+		const gerbv_net_t* net;
+		bool operator<(const sortEntry& other) const {return key < other.key;}
+	};
+	std::vector<sortEntry> entries;
+	QHash<const gerbv_netstate_t*, int> states;
+
+	size_t runStart = 0;
+	while(runStart < order.size()) {
+		//A run of nets of the same layer
+		const gerbv_layer_t* layer = order[runStart]->layer;
+		size_t runEnd = runStart;
+		while(runEnd < order.size() && order[runEnd]->layer == layer) {runEnd++;}
+
+		entries.clear();
+		states.clear();
+		for(size_t i = runStart; i < runEnd; i++) {
+			const gerbv_net_t* cNet = order[i];
+			QHash<const gerbv_netstate_t*, int>::iterator st = states.find(cNet->state);
+			quint64 stateRank;
+			if(st == states.end()) {
+				stateRank = quint64(qMin(states.size(), 0xFFFF));
+				states.insert(cNet->state, int(stateRank));
+			} else {
+				stateRank = quint64(st.value());
+			}
+
+			//The middle of a track, the position of a flash, the first vertex of a region
+			double x = (cNet->start_x + cNet->stop_x) / 2.0;
+			double y = (cNet->start_y + cNet->stop_y) / 2.0;
+			if(cNet->aperture_state == GERBV_APERTURE_STATE_FLASH) {
+				x = cNet->stop_x;
+				y = cNet->stop_y;
+			}
+			quint32 cx = quint32(qBound(0.0, (x - x0) / cellX, double(GERBVQT_REORDER_GRID - 1)));
+			quint32 cy = quint32(qBound(0.0, (y - y0) / cellY, double(GERBVQT_REORDER_GRID - 1)));
+
+			sortEntry e;
+			e.key = (stateRank << 48) | (quint64(quint16(cNet->aperture)) << 32) | mortonKey(cx, cy);
+			e.net = cNet;
+			entries.push_back(e);
+		}
+
+		//Stable, so the nets with the same key keep the file order
+		std::stable_sort(entries.begin(), entries.end());
+		for(size_t i = 0; i < entries.size(); i++) {order[runStart + i] = entries[i].net;}
+		runStart = runEnd;
+	}
+}
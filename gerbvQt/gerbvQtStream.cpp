@@ -0,0 +1,908 @@
+/*
+
+    This file is part of gerbvQt.
+    (c) Kurganov Alexander, 2016 me@sx107.ru
+
+    gerbvQt is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    Foobar is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with gerbvQt.  If not, see <http://www.gnu.org/licenses/>.
+
+*/
+
+//Streaming RS-274X parser (see gerbvQtStream.h).
+//
+//The worker thread reads the file in blocks, splits it into the '*' terminated commands and
+//turns them into gerbv_net_t records laid out the way libgerbv lays them out: a track or a flash
+//is one net, a region polygon is a PAREA_START net followed by its vertex nets and a PAREA_END net.
+//Coordinates are converted to inches, as in libgerbv. A region is never split between two chunks.
+
+#include "gerbvQtStream.h"
+#include <iostream>
+#include <cmath>
+#include <cstring>
+
+using namespace std;
+
+//Bytes read from the file at once
+static const qint64 streamReadBytes = 1 << 16;
+
+//Reads a decimal number with an optional sign and point, without the locale of strtod.
+//digits is the number of digits read.
+static bool readNumber(const std::string& b, size_t& p, double& value, int& digits, bool& point) {
+	bool negative = false;
+	if(p < b.size() && (b[p] == '+' || b[p] == '-')) {
+		negative = (b[p] == '-');
+		p++;
+	}
+	double v = 0.0;
+	int fraction = 0;
+	digits = 0;
+	point = false;
+	for(; p < b.size(); p++) {
+		char c = b[p];
+		if(c == '.' && !point) {
+			point = true;
+			continue;
+		}
+		if(c < '0' || c > '9') {break;}
+		v = v*10.0 + (c - '0');
+		if(point) {fraction++;}
+		digits++;
+	}
+	if(fraction > 0) {v /= pow(10.0, fraction);}
+	value = negative ? -v : v;
+	return digits > 0;
+}
+
+static bool isComment(const std::string& b) {
+	if(b.compare(0, 3, "G04") == 0) {return true;}
+	return b.size() >= 2 && b[0] == 'G' && b[1] == '4' && (b.size() == 2 || b[2] < '0' || b[2] > '9');
+}
+
+//Distance of the farthest point of a standard aperture from its center
+static double apertureExtent(const gerbv_aperture_t* ap) {
+	const double* par = ap->parameter;
+	switch(ap->type) {
+		case GERBV_APTYPE_CIRCLE: return fabs(par[0]) / 2.0;
+		case GERBV_APTYPE_RECTANGLE:
+		case GERBV_APTYPE_OVAL: return hypot(par[0], par[1]) / 2.0;
+		case GERBV_APTYPE_POLYGON: return fabs(par[0]) / 2.0;
+		case GERBV_APTYPE_MACRO: return qMax(0.0, gerbvQt::macroRadius(ap));
+		default: return 0.0;
+	}
+}
+
+//Aperture macro arithmetic: <expression> = <term> {+|- <term>}, <term> = <factor> {x|/ <factor>},
+//<factor> = [+|-] <number> | $<variable> | (<expression>). The undefined variables are 0.
+static bool macroExpression(const std::string& b, size_t& p, const std::map<int, double>& vars, double& value);
+
+static bool macroFactor(const std::string& b, size_t& p, const std::map<int, double>& vars, double& value) {
+	if(p >= b.size()) {return false;}
+	char c = b[p];
+	int digits;
+	bool point;
+	if(c == '+' || c == '-') {
+		p++;
+		if(!macroFactor(b, p, vars, value)) {return false;}
+		if(c == '-') {value = -value;}
+		return true;
+	}
+	if(c == '(') {
+		p++;
+		if(!macroExpression(b, p, vars, value) || p >= b.size() || b[p] != ')') {return false;}
+		p++;
+		return true;
+	}
+	if(c == '$') {
+		p++;
+		double n;
+		if(!readNumber(b, p, n, digits, point)) {return false;}
+		std::map<int, double>::const_iterator var = vars.find(int(n));
+		value = (var == vars.end()) ? 0.0 : var->second;
+		return true;
+	}
+	return readNumber(b, p, value, digits, point);
+}
+
+static bool macroTerm(const std::string& b, size_t& p, const std::map<int, double>& vars, double& value) {
+	if(!macroFactor(b, p, vars, value)) {return false;}
+	while(p < b.size() && (b[p] == 'x' || b[p] == 'X' || b[p] == '/')) {
+		char op = b[p++];
+		double v;
+		if(!macroFactor(b, p, vars, v)) {return false;}
+		if(op == '/') {value /= v;}
+		else {value *= v;}
+	}
+	return true;
+}
+
+static bool macroExpression(const std::string& b, size_t& p, const std::map<int, double>& vars, double& value) {
+	if(!macroTerm(b, p, vars, value)) {return false;}
+	while(p < b.size() && (b[p] == '+' || b[p] == '-')) {
+		char op = b[p++];
+		double v;
+		if(!macroTerm(b, p, vars, v)) {return false;}
+		if(op == '-') {value -= v;}
+		else {value += v;}
+	}
+	return true;
+}
+
+static gerbv_aperture_type_t macroPrimitiveType(int code) {
+	switch(code) {
+		case 1: return GERBV_APTYPE_MACRO_CIRCLE;
+		case 2:
+		case 20: return GERBV_APTYPE_MACRO_LINE20;
+		case 21: return GERBV_APTYPE_MACRO_LINE21;
+		case 22: return GERBV_APTYPE_MACRO_LINE22;
+		case 4: return GERBV_APTYPE_MACRO_OUTLINE;
+		case 5: return GERBV_APTYPE_MACRO_POLYGON;
+		case 6: return GERBV_APTYPE_MACRO_MOIRE;
+		case 7: return GERBV_APTYPE_MACRO_THERMAL;
+		default: return GERBV_APTYPE_NONE;
+	}
+}
+
+//Is the k-th parameter of a macro primitive a size (converted to inches, as in libgerbv)?
+//The exposures, the counts and the rotations aren't.
+static bool macroSize(const gerbv_simplified_amacro_t& prim, int k) {
+	switch(prim.type) {
+		case GERBV_APTYPE_MACRO_CIRCLE: return k >= CIRCLE_DIAMETER && k <= CIRCLE_CENTER_Y;
+		case GERBV_APTYPE_MACRO_OUTLINE: return k >= OUTLINE_FIRST_X && k < OUTLINE_ROTATION + 2*int(prim.parameter[OUTLINE_NUMBER_OF_POINTS]);
+		case GERBV_APTYPE_MACRO_POLYGON: return k >= POLYGON_CENTER_X && k <= POLYGON_DIAMETER;
+		case GERBV_APTYPE_MACRO_MOIRE: return k != MOIRE_NUMBER_OF_CIRCLES && k != MOIRE_ROTATION;
+		case GERBV_APTYPE_MACRO_THERMAL: return k != THERMAL_ROTATION;
+		case GERBV_APTYPE_MACRO_LINE20: return k >= LINE20_LINE_WIDTH && k <= LINE20_END_Y;
+		case GERBV_APTYPE_MACRO_LINE21: return k >= LINE21_WIDTH && k <= LINE21_CENTER_Y;
+		case GERBV_APTYPE_MACRO_LINE22: return k >= LINE22_WIDTH && k <= LINE22_LOWER_LEFT_Y;
+		default: return false;
+	}
+}
+
+//Box of the net path (with the whole circle of an arc) extended by the aperture
+static gerbv_render_size_t netBox(const gerbv_net_t* net, double extent) {
+	gerbv_render_size_t box;
+	box.left = qMin(net->start_x, net->stop_x);
+	box.right = qMax(net->start_x, net->stop_x);
+	box.bottom = qMin(net->start_y, net->stop_y);
+	box.top = qMax(net->start_y, net->stop_y);
+	if(net->cirseg != NULL) {
+		double r = net->cirseg->width / 2.0;
+		box.left = qMin(box.left, net->cirseg->cp_x - r);
+		box.right = qMax(box.right, net->cirseg->cp_x + r);
+		box.bottom = qMin(box.bottom, net->cirseg->cp_y - r);
+		box.top = qMax(box.top, net->cirseg->cp_y + r);
+	}
+	box.left -= extent;
+	box.right += extent;
+	box.bottom -= extent;
+	box.top += extent;
+	return box;
+}
+
+static void uniteBox(gerbv_render_size_t& box, const gerbv_render_size_t& other) {
+	box.left = qMin(box.left, other.left);
+	box.right = qMax(box.right, other.right);
+	box.bottom = qMin(box.bottom, other.bottom);
+	box.top = qMax(box.top, other.top);
+}
+
+gerbvQtStream::gerbvQtStream() : stopping(false) {
+	droppedChunks = 0;
+	headerDone = false;
+	finished = false;
+	failed = false;
+	unsupportedFile = false;
+	chunkIndex = 0;
+	netIndex = 0;
+	current = NULL;
+	started = false;
+	keepAll = false;
+	shell = NULL;
+}
+
+gerbvQtStream::~gerbvQtStream() {
+	close();
+}
+
+bool gerbvQtStream::open(const QString& fileName) {
+	close();
+	file.setFileName(fileName);
+	if(!file.open(QFile::ReadOnly)) {
+		cerr << "gerbvQtStream: can't open " << fileName.toLocal8Bit().constData() << endl;
+		return false;
+	}
+
+	//The shell image, filled as the header commands are parsed
+	shell = new gerbv_image_t;
+	memset(shell, 0, sizeof(gerbv_image_t));
+	memset(&shellInfo, 0, sizeof(shellInfo));
+	memset(&shellState, 0, sizeof(shellState));
+	shellInfo.polarity = GERBV_POLARITY_POSITIVE;
+	shellState.axisSelect = GERBV_AXIS_SELECT_NOSELECT;
+	shellState.mirrorState = GERBV_MIRROR_STATE_NOMIRROR;
+	shellState.unit = GERBV_UNIT_INCH;
+	shellState.scaleA = 1.0;
+	shellState.scaleB = 1.0;
+
+	gerbv_layer_t layer;
+	memset(&layer, 0, sizeof(layer));
+	layer.polarity = GERBV_POLARITY_DARK;
+	layer.stepAndRepeat.X = 1;
+	layer.stepAndRepeat.Y = 1;
+	layers.push_back(layer);
+
+	shell->layertype = GERBV_LAYERTYPE_RS274X;
+	shell->info = &shellInfo;
+	shell->layers = &layers.front();
+	shell->states = &shellState;
+
+	//Parser state: the defaults of the RS-274X specification
+	xInt = yInt = 2;
+	xDec = yDec = 4;
+	formatSet = false;
+	omitTrailing = false;
+	incremental = false;
+	unitScale = 1.0;
+	inMacro = false;
+	macroName.clear();
+	unsupportedFound = false;
+	ended = false;
+	aperture = 0;
+	lastOperation = 2;
+	interpolation = GERBV_INTERPOLATION_LINEARx1;
+	multiQuadrant = false;
+	cx = cy = 0.0;
+	inRegion = false;
+	polygonStart = NULL;
+	polygonLast = NULL;
+	anyNets = false;
+	boundsSet = false;
+	minX = minY = maxX = maxY = 0.0;
+
+	building.reset(new streamChunk);
+	worker = std::thread(&gerbvQtStream::parse, this);
+	return true;
+}
+
+void gerbvQtStream::close() {
+	if(worker.joinable()) {
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			stopping = true;
+		}
+		consumed.notify_all();
+		worker.join();
+	}
+	file.close();
+
+	chunks.clear();
+	building.reset();
+	warned.clear();
+	layers.clear();
+	apertures.clear();
+	primitives.clear();
+	macros.clear();
+	delete shell;
+	shell = NULL;
+
+	droppedChunks = 0;
+	headerDone = false;
+	finished = false;
+	failed = false;
+	unsupportedFile = false;
+	stopping = false;
+	chunkIndex = 0;
+	netIndex = 0;
+	current = NULL;
+	started = false;
+}
+
+const gerbv_image_t* gerbvQtStream::image() {
+	if(shell == NULL) {return NULL;}
+	std::unique_lock<std::mutex> lock(mutex);
+	ready.wait(lock, [this] {return headerDone || finished;});
+	return shell;
+}
+
+bool gerbvQtStream::wait() {
+	if(shell == NULL) {return false;}
+	std::unique_lock<std::mutex> lock(mutex);
+	ready.wait(lock, [this] {return finished;});
+	return !failed;
+}
+
+bool gerbvQtStream::unsupported() {
+	std::lock_guard<std::mutex> lock(mutex);
+	return unsupportedFile;
+}
+
+const gerbv_net_t* gerbvQtStream::first() {
+	if(shell == NULL) {return NULL;}
+	if(started && !keepAll) {
+		cerr << "gerbvQtStream: the nets aren't kept (see setKeepNets), the stream can't be walked again." << endl;
+		return NULL;
+	}
+	started = true;
+	chunkIndex = 0;
+	netIndex = 0;
+	current = NULL;
+	return next();
+}
+
+const gerbv_net_t* gerbvQtStream::next() {
+	if(shell == NULL) {return NULL;}
+	while(true) {
+		if(current != NULL && netIndex < current->renderable.size()) {return current->renderable[netIndex++];}
+
+		//The chunk is drawn, wait for the next one. The drawn chunk is freed after unlocking.
+		std::unique_ptr<streamChunk> done;
+		std::unique_lock<std::mutex> lock(mutex);
+		if(current != NULL) {
+			if(!keepAll) {
+				done.swap(chunks.front());
+				chunks.pop_front();
+				droppedChunks++;
+				consumed.notify_one();
+			}
+			chunkIndex++;
+			current = NULL;
+		}
+		ready.wait(lock, [this] {return chunkIndex - droppedChunks < chunks.size() || finished;});
+		if(chunkIndex - droppedChunks >= chunks.size()) {return NULL;}
+		current = chunks[chunkIndex - droppedChunks].get();
+		netIndex = 0;
+	}
+}
+
+void gerbvQtStream::parse() {
+	std::vector<char> buffer(streamReadBytes);
+	std::string block;
+	bool extended = false;
+	bool readError = false;
+
+	while(!ended && !stopping) {
+		qint64 n = file.read(buffer.data(), streamReadBytes);
+		if(n < 0) {
+			readError = true;
+			break;
+		}
+		if(n == 0) {break;}
+
+		for(qint64 k = 0; k < n && !ended && !stopping; k++) {
+			char c = buffer[k];
+			if(c == '%' && !isComment(block)) {
+				//Start or end of the extended commands
+				if(extended && !block.empty()) {parseExtended(block);}
+				block.clear();
+				extended = !extended;
+				inMacro = false;
+			} else if(c == '*') {
+				if(extended) {parseExtended(block);}
+				else {parseData(block);}
+				block.clear();
+			} else if(c > ' ') {
+				block += c;
+			}
+		}
+	}
+	if(readError) {cerr << "gerbvQtStream: can't read " << file.fileName().toLocal8Bit().constData() << endl;}
+	if(stopping) {return;}
+
+	//An unterminated region
+	if(polygonStart != NULL) {closePolygon();}
+
+	//The image box is known only now
+	shellInfo.min_x = minX;
+	shellInfo.min_y = minY;
+	shellInfo.max_x = maxX;
+	shellInfo.max_y = maxY;
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		failed = readError || unsupportedFound;
+		unsupportedFile = unsupportedFound;
+	}
+	publish(true);
+}
+
+void gerbvQtStream::parseExtended(const std::string& b) {
+	//The statements of an aperture macro, evaluated by every %AD using it
+	if(inMacro) {
+		macros[macroName].push_back(b);
+		return;
+	}
+	if(b.size() < 2) {return;}
+
+	std::string code = b.substr(0, 2);
+	if(code == "FS") {
+		parseFormat(b);
+	} else if(code == "MO") {
+		unitScale = (b.compare(2, 2, "MM") == 0) ? 1.0/25.4 : 1.0;
+	} else if(code == "AD") {
+		parseAperture(b);
+	} else if(code == "AM") {
+		macroName = b.substr(2);
+		macros[macroName].clear();
+		inMacro = true;
+	} else if(code == "LP") {
+		newLayer();
+		layers.back().polarity = (b.compare(2, 1, "C") == 0) ? GERBV_POLARITY_CLEAR : GERBV_POLARITY_DARK;
+	} else if(code == "SR") {
+		parseStepRepeat(b);
+	} else if(code == "IP") {
+		//The renderer reads the polarity once the first chunk is published
+		if(anyNets) {warnOnce("%IP after the first objects is ignored");}
+		else {shellInfo.polarity = (b.compare(2, 3, "NEG") == 0) ? GERBV_POLARITY_NEGATIVE : GERBV_POLARITY_POSITIVE;}
+	} else if(code == "AB") {
+		//The block's objects would have to be kept until it is flashed: give the file to libgerbv
+		cerr << "gerbvQtStream: aperture blocks aren't supported, " << file.fileName().toLocal8Bit().constData() << " has to be read with libgerbv" << endl;
+		unsupportedFound = true;
+		ended = true;
+	} else if(code == "TF" || code == "TA" || code == "TO" || code == "TD" || code == "IN" || code == "LN") {
+		//Attributes and names, nothing to render
+	} else {
+		warnOnce("%" + code + " isn't supported, ignored");
+	}
+}
+
+void gerbvQtStream::parseFormat(const std::string& b) {
+	//FS<L|T><A|I>X<int><dec>Y<int><dec>
+	formatSet = true;
+	for(size_t p = 2; p < b.size(); p++) {
+		char c = b[p];
+		if(c == 'L') {omitTrailing = false;}
+		else if(c == 'T') {omitTrailing = true;}
+		else if(c == 'A') {incremental = false;}
+		else if(c == 'I') {incremental = true;}
+		else if((c == 'X' || c == 'Y') && p + 2 < b.size()) {
+			int i = b[p+1] - '0';
+			int d = b[p+2] - '0';
+			if(c == 'X') {xInt = i; xDec = d;}
+			else {yInt = i; yDec = d;}
+			p += 2;
+		}
+	}
+}
+
+void gerbvQtStream::parseAperture(const std::string& b) {
+	//ADD<number><template>[,<parameter>X<parameter>...]
+	size_t p = 2;
+	if(p < b.size() && b[p] == 'D') {p++;}
+	double v;
+	int digits;
+	bool point;
+	if(!readNumber(b, p, v, digits, point) || v < 10 || v >= APERTURE_MAX) {
+		cerr << "gerbvQtStream: bad aperture definition " << b << endl;
+		return;
+	}
+	int number = int(v);
+
+	size_t comma = b.find(',', p);
+	std::string name = b.substr(p, (comma == std::string::npos) ? std::string::npos : comma - p);
+	std::vector<double> params;
+	if(comma != std::string::npos) {
+		p = comma + 1;
+		while(readNumber(b, p, v, digits, point)) {
+			params.push_back(v);
+			if(p < b.size() && b[p] == 'X') {p++;}
+			else {break;}
+		}
+	}
+
+	gerbv_aperture_type_t type;
+	std::map<std::string, std::vector<std::string> >::const_iterator macro = macros.end();
+	if(name == "C") {type = GERBV_APTYPE_CIRCLE;}
+	else if(name == "R") {type = GERBV_APTYPE_RECTANGLE;}
+	else if(name == "O") {type = GERBV_APTYPE_OVAL;}
+	else if(name == "P") {type = GERBV_APTYPE_POLYGON;}
+	else {
+		macro = macros.find(name);
+		if(macro == macros.end()) {
+			cerr << "gerbvQtStream: undefined aperture macro " << name << endl;
+			return;
+		}
+		type = GERBV_APTYPE_MACRO;
+	}
+
+	//The renderer may already be drawing with the old one: give the file to libgerbv
+	if(shell->aperture[number] != NULL) {
+		cerr << "gerbvQtStream: D" << number << " is redefined, " << file.fileName().toLocal8Bit().constData() << " has to be read with libgerbv" << endl;
+		unsupportedFound = true;
+		ended = true;
+		return;
+	}
+
+	gerbv_aperture_t ap;
+	memset(&ap, 0, sizeof(ap));
+	ap.type = type;
+	ap.unit = GERBV_UNIT_INCH;
+	ap.nuf_parameters = qMin(int(params.size()), int(APERTURE_PARAMETERS_MAX));
+	for(int k = 0; k < ap.nuf_parameters; k++) {
+		//The vertex count and the rotation of a polygon aren't sizes, the macro modifiers are scaled once evaluated
+		bool size = !(type == GERBV_APTYPE_MACRO || (type == GERBV_APTYPE_POLYGON && (k == 1 || k == 2)));
+		ap.parameter[k] = size ? params[k] * unitScale : params[k];
+	}
+	if(type == GERBV_APTYPE_MACRO && !evaluateMacro(macro->second, params, ap)) {
+		cerr << "gerbvQtStream: bad aperture macro " << name << ", D" << number << " is skipped" << endl;
+		return;
+	}
+	apertures.push_back(ap);
+	shell->aperture[number] = &apertures.back();
+}
+
+bool gerbvQtStream::evaluateMacro(const std::vector<std::string>& body, const std::vector<double>& modifiers, gerbv_aperture_t& ap) {
+	//$1, $2... are the modifiers of the %AD, the body may define more variables
+	std::map<int, double> vars;
+	for(size_t k = 0; k < modifiers.size(); k++) {vars[int(k) + 1] = modifiers[k];}
+
+	std::vector<gerbv_simplified_amacro_t> prims;
+	for(size_t s = 0; s < body.size(); s++) {
+		const std::string& b = body[s];
+		size_t p = 0;
+		double v;
+
+		//Primitive 0 is a comment
+		if(b.empty() || b[0] == '0') {continue;}
+
+		if(b[0] == '$') {
+			//$<variable>=<expression>
+			size_t eq = b.find('=');
+			int digits;
+			bool point;
+			double n;
+			p = 1;
+			if(eq == std::string::npos || !readNumber(b, p, n, digits, point) || p != eq) {return false;}
+			p = eq + 1;
+			if(!macroExpression(b, p, vars, v) || p != b.size()) {return false;}
+			vars[int(n)] = v;
+			continue;
+		}
+
+		//<code>,<parameter>,<parameter>...
+		std::vector<double> values;
+		while(true) {
+			if(!macroExpression(b, p, vars, v)) {return false;}
+			values.push_back(v);
+			if(p >= b.size()) {break;}
+			if(b[p] != ',') {return false;}
+			p++;
+		}
+		int count = int(values.size()) - 1;
+		if(count > APERTURE_PARAMETERS_MAX) {return false;}
+
+		gerbv_simplified_amacro_t prim;
+		memset(&prim, 0, sizeof(prim));
+		prim.type = macroPrimitiveType(int(values[0]));
+		if(prim.type == GERBV_APTYPE_NONE) {return false;}
+		for(int k = 0; k < count; k++) {prim.parameter[k] = values[k + 1];}
+
+		//The rotation of an outline follows its vertices
+		if(prim.type == GERBV_APTYPE_MACRO_OUTLINE) {
+			double points = prim.parameter[OUTLINE_NUMBER_OF_POINTS];
+			if(!(points >= 1.0) || OUTLINE_ROTATION + 2*points >= APERTURE_PARAMETERS_MAX) {return false;}
+		}
+		for(int k = 0; k < count; k++) {
+			if(macroSize(prim, k)) {prim.parameter[k] *= unitScale;}
+		}
+		prims.push_back(prim);
+	}
+
+	//Linked in the deque, which keeps the addresses as it grows
+	size_t start = primitives.size();
+	for(size_t k = 0; k < prims.size(); k++) {
+		primitives.push_back(prims[k]);
+		if(k > 0) {primitives[start + k - 1].next = &primitives.back();}
+	}
+	ap.simplified = prims.empty() ? NULL : &primitives[start];
+	return true;
+}
+
+void gerbvQtStream::parseStepRepeat(const std::string& b) {
+	//SR[X<count>Y<count>I<step>J<step>], SR alone ends the step and repeat
+	int countX = 1, countY = 1;
+	double stepX = 0.0, stepY = 0.0;
+	size_t p = 2;
+	while(p < b.size()) {
+		char c = b[p++];
+		double v;
+		int digits;
+		bool point;
+		if(!readNumber(b, p, v, digits, point)) {break;}
+		if(c == 'X') {countX = qMax(1, int(v));}
+		else if(c == 'Y') {countY = qMax(1, int(v));}
+		else if(c == 'I') {stepX = v * unitScale;}
+		else if(c == 'J') {stepY = v * unitScale;}
+	}
+	newLayer();
+	gerbv_step_and_repeat_t& sr = layers.back().stepAndRepeat;
+	sr.X = countX;
+	sr.Y = countY;
+	sr.dist_X = stepX;
+	sr.dist_Y = stepY;
+}
+
+bool gerbvQtStream::readCoordinate(const std::string& b, size_t& p, bool isX, double& value) {
+	if(!formatSet) {
+		warnOnce("no %FS before the coordinates, they are read as 2.4 with the leading zeros omitted");
+		formatSet = true;
+	}
+	double v;
+	int digits;
+	bool point;
+	if(!readNumber(b, p, v, digits, point)) {return false;}
+	if(!point) {
+		int intDigits = isX ? xInt : yInt;
+		int decDigits = isX ? xDec : yDec;
+		int shift = (omitTrailing ? intDigits + decDigits - digits : 0) - decDigits;
+		v *= pow(10.0, shift);
+	}
+	value = v * unitScale;
+	return true;
+}
+
+void gerbvQtStream::parseData(const std::string& b) {
+	if(b.empty() || isComment(b)) {return;}
+
+	bool hasX = false, hasY = false;
+	double x = 0.0, y = 0.0, i = 0.0, j = 0.0;
+	int d = -1;
+	size_t p = 0;
+	while(p < b.size()) {
+		char letter = b[p++];
+		double v;
+		int digits;
+		bool point;
+		switch(letter) {
+			case 'G':
+				if(!readNumber(b, p, v, digits, point)) {return;}
+				switch(int(v)) {
+					case 1: interpolation = GERBV_INTERPOLATION_LINEARx1; break;
+					case 2: interpolation = GERBV_INTERPOLATION_CW_CIRCULAR; break;
+					case 3: interpolation = GERBV_INTERPOLATION_CCW_CIRCULAR; break;
+					case 4: return;
+					case 36: inRegion = true; break;
+					case 37:
+						if(polygonStart != NULL) {closePolygon();}
+						inRegion = false;
+						break;
+					case 54: case 55: break;
+					case 70: unitScale = 1.0; break;
+					case 71: unitScale = 1.0/25.4; break;
+					case 74: multiQuadrant = false; break;
+					case 75: multiQuadrant = true; break;
+					case 90: incremental = false; break;
+					case 91: incremental = true; break;
+					default: warnOnce("G" + b.substr(1, p - 1) + " isn't supported, ignored"); break;
+				}
+				break;
+			case 'X': hasX = readCoordinate(b, p, true, x); break;
+			case 'Y': hasY = readCoordinate(b, p, false, y); break;
+			case 'I': readCoordinate(b, p, true, i); break;
+			case 'J': readCoordinate(b, p, false, j); break;
+			case 'D':
+				if(!readNumber(b, p, v, digits, point)) {return;}
+				if(v < 10) {d = int(v);}
+				else if(v < APERTURE_MAX) {aperture = int(v);}
+				break;
+			case 'M':
+				if(!readNumber(b, p, v, digits, point)) {return;}
+				if(int(v) == 0 || int(v) == 2) {ended = true;}
+				break;
+			case 'N':
+				readNumber(b, p, v, digits, point);
+				break;
+			default:
+				warnOnce(std::string("unknown command ") + b);
+				return;
+		}
+	}
+
+	//Coordinates without a D code repeat the last operation (deprecated, but common)
+	if(d < 0) {
+		if(!hasX && !hasY) {return;}
+		d = lastOperation;
+	}
+	lastOperation = d;
+
+	double nx = cx, ny = cy;
+	if(hasX) {nx = incremental ? cx + x : x;}
+	if(hasY) {ny = incremental ? cy + y : y;}
+	switch(d) {
+		case 1: interpolate(nx, ny, i, j); break;
+		case 2: if(polygonStart != NULL) {closePolygon();} break;
+		case 3: flash(nx, ny); break;
+		default: break;
+	}
+	cx = nx;
+	cy = ny;
+}
+
+void gerbvQtStream::warnOnce(const std::string& what) {
+	if(warned.insert(what).second) {cerr << "gerbvQtStream: " << what << endl;}
+}
+
+void gerbvQtStream::newLayer() {
+	//A copy of the current layer, as in libgerbv
+	gerbv_layer_t layer = layers.back();
+	layer.name = NULL;
+	layer.next = NULL;
+	layers.push_back(layer);
+	layers[layers.size() - 2].next = &layers.back();
+}
+
+gerbv_net_t* gerbvQtStream::newNet(gerbv_interpolation_t interp, double x, double y) {
+	building->nets.push_back(gerbv_net_t());
+	gerbv_net_t* net = &building->nets.back();
+	memset(net, 0, sizeof(gerbv_net_t));
+	net->start_x = cx;
+	net->start_y = cy;
+	net->stop_x = x;
+	net->stop_y = y;
+	net->aperture = aperture;
+	net->aperture_state = GERBV_APERTURE_STATE_ON;
+	net->interpolation = interp;
+	net->layer = &layers.back();
+	net->state = &shellState;
+	return net;
+}
+
+void gerbvQtStream::setCirseg(gerbv_net_t* net, double i, double j) {
+	//The arc as libgerbv stores it: the center, the circle size and the angles (in degrees) of the ends
+	bool cw = (net->interpolation == GERBV_INTERPOLATION_CW_CIRCULAR);
+	double sx = net->start_x, sy = net->start_y;
+	double ex = net->stop_x, ey = net->stop_y;
+	double px = sx + i, py = sy + j;
+	if(!multiQuadrant) {
+		//The signs of the offsets aren't given: the center is the one equally far from both ends
+		//with the arc of at most 90 degrees
+		double best = -1.0;
+		for(int k = 0; k < 4; k++) {
+			double qx = sx + ((k & 1) ? -i : i);
+			double qy = sy + ((k & 2) ? -j : j);
+			double sweep = atan2(ey - qy, ex - qx) - atan2(sy - qy, sx - qx);
+			if(cw) {sweep = -sweep;}
+			if(sweep < 0.0) {sweep += 2.0*M_PI;}
+			if(sweep > M_PI/2.0 + 1e-6) {continue;}
+			double err = fabs(hypot(sx - qx, sy - qy) - hypot(ex - qx, ey - qy));
+			if(best < 0.0 || err < best) {
+				best = err;
+				px = qx;
+				py = qy;
+			}
+		}
+	}
+
+	double alfa = atan2(sy - py, sx - px);
+	double beta = atan2(ey - py, ex - px);
+	if(alfa < 0.0) {alfa += 2.0*M_PI;}
+	if(beta < 0.0) {beta += 2.0*M_PI;}
+	//A multi quadrant arc with the same ends is a full circle
+	if(cw) {
+		if(multiQuadrant ? (alfa - beta < 1e-6) : (alfa < beta)) {beta -= 2.0*M_PI;}
+	} else {
+		if(multiQuadrant ? (beta - alfa < 1e-6) : (beta < alfa)) {beta += 2.0*M_PI;}
+	}
+
+	building->cirsegs.push_back(gerbv_cirseg_t());
+	gerbv_cirseg_t* cirseg = &building->cirsegs.back();
+	cirseg->cp_x = px;
+	cirseg->cp_y = py;
+	cirseg->width = 2.0 * hypot(sx - px, sy - py);
+	cirseg->height = cirseg->width;
+	cirseg->angle1 = alfa * 180.0 / M_PI;
+	cirseg->angle2 = beta * 180.0 / M_PI;
+	net->cirseg = cirseg;
+}
+
+void gerbvQtStream::addBounds(const gerbv_render_size_t& box) {
+	//The image box, with all the step and repeat copies
+	const gerbv_step_and_repeat_t& sr = layers.back().stepAndRepeat;
+	double dx = (sr.X - 1) * sr.dist_X;
+	double dy = (sr.Y - 1) * sr.dist_Y;
+	double x0 = box.left + qMin(0.0, dx), x1 = box.right + qMax(0.0, dx);
+	double y0 = box.bottom + qMin(0.0, dy), y1 = box.top + qMax(0.0, dy);
+	if(!boundsSet) {
+		minX = x0; maxX = x1;
+		minY = y0; maxY = y1;
+		boundsSet = true;
+		return;
+	}
+	minX = qMin(minX, x0);
+	maxX = qMax(maxX, x1);
+	minY = qMin(minY, y0);
+	maxY = qMax(maxY, y1);
+}
+
+void gerbvQtStream::addRenderable(const gerbv_net_t* net) {
+	building->renderable.push_back(net);
+	anyNets = true;
+
+	//The first chunk is small, so the drawing starts early
+	size_t limit = headerDone ? GERBVQT_STREAM_CHUNK : GERBVQT_STREAM_CHUNK / 16;
+	if(building->renderable.size() >= limit) {publish(false);}
+}
+
+void gerbvQtStream::interpolate(double x, double y, double i, double j) {
+	bool circular = (interpolation == GERBV_INTERPOLATION_CW_CIRCULAR || interpolation == GERBV_INTERPOLATION_CCW_CIRCULAR);
+	if(inRegion) {
+		if(polygonStart == NULL) {
+			polygonStart = newNet(GERBV_INTERPOLATION_PAREA_START, cx, cy);
+			polygonStart->boundingBox = netBox(polygonStart, 0.0);
+
+			//The polygon starts at the stop point of the first vertex
+			polygonLast = newNet(GERBV_INTERPOLATION_LINEARx1, cx, cy);
+			polygonStart->next = polygonLast;
+		}
+		gerbv_net_t* vertex = newNet(interpolation, x, y);
+		if(circular) {setCirseg(vertex, i, j);}
+		polygonLast->next = vertex;
+		polygonLast = vertex;
+		uniteBox(polygonStart->boundingBox, netBox(vertex, 0.0));
+		return;
+	}
+
+	const gerbv_aperture_t* ap = shell->aperture[aperture];
+	if(ap == NULL) {
+		warnOnce("objects drawn with an undefined aperture are skipped");
+		return;
+	}
+	gerbv_net_t* net = newNet(interpolation, x, y);
+	if(circular) {setCirseg(net, i, j);}
+	net->boundingBox = netBox(net, apertureExtent(ap));
+	addBounds(net->boundingBox);
+	addRenderable(net);
+}
+
+void gerbvQtStream::flash(double x, double y) {
+	if(inRegion) {
+		warnOnce("flashes in regions are skipped");
+		return;
+	}
+	const gerbv_aperture_t* ap = shell->aperture[aperture];
+	if(ap == NULL) {
+		warnOnce("objects drawn with an undefined aperture are skipped");
+		return;
+	}
+	gerbv_net_t* net = newNet(GERBV_INTERPOLATION_LINEARx1, x, y);
+	net->start_x = x;
+	net->start_y = y;
+	net->aperture_state = GERBV_APERTURE_STATE_FLASH;
+	net->boundingBox = netBox(net, apertureExtent(ap));
+	addBounds(net->boundingBox);
+	addRenderable(net);
+}
+
+void gerbvQtStream::closePolygon() {
+	polygonLast->next = newNet(GERBV_INTERPOLATION_PAREA_END, cx, cy);
+	gerbv_net_t* start = polygonStart;
+	polygonStart = NULL;
+	polygonLast = NULL;
+	addBounds(start->boundingBox);
+	addRenderable(start);
+}
+
+void gerbvQtStream::publish(bool last) {
+	std::unique_ptr<streamChunk> fresh(last ? nullptr : new streamChunk);
+	std::unique_lock<std::mutex> lock(mutex);
+
+	//Don't run too far ahead of the renderer
+	if(!keepAll) {consumed.wait(lock, [this] {return chunks.size() < GERBVQT_STREAM_AHEAD || stopping;});}
+	if(stopping) {return;}
+
+	if(!building->renderable.empty()) {
+		chunks.push_back(std::move(building));
+		building = std::move(fresh);
+	}
+	headerDone = true;
+	if(last) {finished = true;}
+	ready.notify_all();
+}
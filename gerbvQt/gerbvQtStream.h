@@ -0,0 +1,188 @@
+/*
+
+    This file is part of gerbvQt.
+    (c) Kurganov Alexander, 2016 me@sx107.ru
+
+    gerbvQt is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    Foobar is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with gerbvQt.  If not, see <http://www.gnu.org/licenses/>.
+
+*/
+
+
+#ifndef GERBVQTSTREAM
+#define GERBVQTSTREAM
+#include "gerbv.h"
+#include "gerbvQt.h"
+#include <QFile>
+#include <QString>
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <set>
+#include <string>
+#include <thread>
+#include <vector>
+
+//Renderable nets per chunk handed from the parser to the renderer
+#define GERBVQT_STREAM_CHUNK 4096
+
+//Chunks the parser may be ahead of the renderer (unless the nets are kept, see setKeepNets)
+#define GERBVQT_STREAM_AHEAD 64
+
+//Parses an RS-274X file on a worker thread straight into renderable nets, without libgerbv.
+//
+//The nets are handed to the renderer in chunks as soon as they are parsed, so the drawing starts
+//with the first chunk and the consumed chunks are freed: neither the whole file nor the whole
+//netlist is ever in memory.
+//
+//Typical usage:
+//	gerbvQtStream stream;
+//	stream.open("board.gbr");
+//	gqt.renderStreamToQt(&qtimage, &stream, transform, &renderInfo);
+//
+//The image box is known only at the end of the file, so renderInfo can't be autoscaled from it.
+//
+//Supported: %FS, %MO, %AM (with the variables and the arithmetic expressions), %AD with the standard
+//apertures (C, R, O, P) and the macros, %LP, %SR, %IP, G01/02/03, G36/37, G74/75, G70/71, G90/91,
+//D01/02/03, Dnn and M02. The deprecated image parameters (OF, IR, MI, SF, KO...) are reported once and ignored.
+//
+//Aperture blocks (%AB) and the redefinitions of a D code (legacy files) can't be streamed: the parsing
+//stops there, wait() returns false and unsupported() returns true. Render such files with libgerbv (gerbv_open_layer_from_filename, gerbvQt::renderImageToQt):
+//	if(!stream.wait() && stream.unsupported()) {...}
+class gerbvQtStream : public gerbvQtNetSource {
+	public:
+		gerbvQtStream();
+		~gerbvQtStream();
+
+		//Keep all the parsed nets until close(), so the stream can be walked again
+		//(planner, supersampling, net reordering). Must be set before open.
+		void setKeepNets(bool _keepNets) {keepAll = _keepNets;}
+		bool keepNets(void) {return keepAll;}
+
+		//Opens the file and starts parsing it on the worker thread
+		bool open(const QString& fileName);
+
+		//Stops the parser and frees everything
+		void close();
+
+		//A gerbv_image_t shell with the info, the aperture table and the layers, but without the netlist.
+		//Blocks until the first chunk is parsed (the header of the file is read by then). NULL if nothing is open.
+		//The info box (min/max) is valid only after the whole file is parsed.
+		const gerbv_image_t* image();
+
+		//Waits for the end of the file. Returns false on a read error or an unsupported file (see unsupported).
+		//Without setKeepNets(true) the parser waits for the renderer, so wait only after rendering.
+		bool wait();
+		
+		//Did the parsing stop at something the stream can't draw (an aperture block, a redefined D code)?
+		//The rendered picture is incomplete then, render the file with libgerbv. Valid after wait().
+		bool unsupported();
+
+		const gerbv_net_t* first();
+		const gerbv_net_t* next();
+		bool canReorder() {return keepAll;}
+		bool canRestart() {return keepAll;}
+
+	private:
+		//Forbid copying, the nets point into the stream
+		gerbvQtStream(const gerbvQtStream&);
+		gerbvQtStream& operator=(const gerbvQtStream&);
+
+		//The nets are in deques, so the pointers stay valid while the chunk grows
+		struct streamChunk {
+			std::deque<gerbv_net_t> nets;
+			std::deque<gerbv_cirseg_t> cirsegs;
+			std::vector<const gerbv_net_t*> renderable;
+		};
+
+		//Worker thread
+		void parse();
+		void parseExtended(const std::string& b);
+		void parseData(const std::string& b);
+		void parseFormat(const std::string& b);
+		void parseAperture(const std::string& b);
+		bool evaluateMacro(const std::vector<std::string>& body, const std::vector<double>& modifiers, gerbv_aperture_t& ap);
+		void parseStepRepeat(const std::string& b);
+		bool readCoordinate(const std::string& b, size_t& p, bool isX, double& value);
+		void warnOnce(const std::string& what);
+
+		void newLayer();
+		gerbv_net_t* newNet(gerbv_interpolation_t interpolation, double x, double y);
+		void setCirseg(gerbv_net_t* net, double i, double j);
+		void addBounds(const gerbv_render_size_t& box);
+		void addRenderable(const gerbv_net_t* net);
+		void interpolate(double x, double y, double i, double j);
+		void flash(double x, double y);
+		void closePolygon();
+		void publish(bool last);
+
+		//Shared with the renderer, under the mutex
+		std::mutex mutex;
+		std::condition_variable ready;		//A chunk is published or the parsing is finished
+		std::condition_variable consumed;	//A chunk is freed or the parser has to stop
+		std::deque<std::unique_ptr<streamChunk> > chunks;
+		size_t droppedChunks;
+		bool headerDone;
+		bool finished;
+		bool failed;
+		bool unsupportedFile;
+		std::atomic<bool> stopping;
+
+		//Renderer side. The current chunk is published, so it is read without the lock.
+		size_t chunkIndex;
+		size_t netIndex;
+		streamChunk* current;
+		bool started;
+
+		//Parser side
+		std::thread worker;
+		QFile file;
+		bool keepAll;
+		std::unique_ptr<streamChunk> building;
+		std::set<std::string> warned;
+
+		gerbv_image_t* shell;
+		gerbv_image_info_t shellInfo;
+		gerbv_netstate_t shellState;
+		std::deque<gerbv_layer_t> layers;
+		std::deque<gerbv_aperture_t> apertures;
+		std::deque<gerbv_simplified_amacro_t> primitives;
+		std::map<std::string, std::vector<std::string> > macros;	//The statements of every %AM, by name
+
+		//Parser state
+		int xInt, xDec, yInt, yDec;
+		bool formatSet;
+		bool omitTrailing;
+		bool incremental;
+		double unitScale;			//To inches
+		bool inMacro;
+		std::string macroName;
+		bool unsupportedFound;
+		bool ended;
+		int aperture;
+		int lastOperation;
+		gerbv_interpolation_t interpolation;
+		bool multiQuadrant;
+		double cx, cy;
+		bool inRegion;
+		gerbv_net_t* polygonStart;		//The PAREA_START net of the open region polygon
+		gerbv_net_t* polygonLast;
+		bool anyNets;
+		bool boundsSet;
+		double minX, minY, maxX, maxY;
+};
+
+#endif
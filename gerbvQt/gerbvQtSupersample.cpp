@@ -0,0 +1,273 @@
+/*
+
+    This file is part of gerbvQt.
+    (c) Kurganov Alexander, 2016 me@sx107.ru
+
+    gerbvQt is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    Foobar is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with gerbvQt.  If not, see <http://www.gnu.org/licenses/>.
+
+*/
+
+//Supersampled antialiasing (see gerbvQt::setSupersampling).
+//
+//The image is rendered aliased into 1bpp bands at N times the resolution (all the fast 1bpp paths apply),
+//then every N x N block is counted and the coverage is composited into the device.
+//All the shapes are merged in the 1bpp band before the filtering, so there are no seams
+//between adjacent shapes, unlike with QPainter's per-shape antialiasing.
+//
+//gerbvQt::compositeMask uses the same compositing to tint the 8-bit coverage masks.
+
+#include "gerbvQt.h"
+#include <cstring>
+#include <vector>
+
+using namespace std;
+
+//Number of set bits of a value up to 16 bits
+static inline int popcount16(uint v) {
+	v = v - ((v >> 1) & 0x5555);
+	v = (v & 0x3333) + ((v >> 2) & 0x3333);
+	v = (v + (v >> 4)) & 0x0F0F;
+	return int((v + (v >> 8)) & 0x1F);
+}
+
+//Sums the set bits of every n-bit group of the n rows of a Format_Mono band: sums[x] for x in [0, width)
+static void countBlocks(const QImage& band, int row, int n, int width, bool invert, std::vector<int>& sums) {
+	std::fill(sums.begin(), sums.end(), 0);
+	for(int k = 0; k < n; k++) {
+		const uchar* line = band.constScanLine(row*n + k);
+		for(int x = 0; x < width; x++) {
+			//A big endian window of 24 bits holds any group of up to 16 bits
+			int bit = x * n;
+			const uchar* b = line + (bit >> 3);
+			uint w = (uint(b[0]) << 16) | (uint(b[1]) << 8) | uint(b[2]);
+			if(invert) {w = ~w;}
+			sums[x] += popcount16((w >> (24 - (bit & 7) - n)) & ((1u << n) - 1));
+		}
+	}
+}
+
+//The same for n = 4 with SWAR: nibble counts of 8 bytes (16 pixels) at once
+static void countBlocks4(const QImage& band, int row, int width, bool invert, std::vector<int>& sums) {
+	const quint64 m1 = 0x5555555555555555ULL, m2 = 0x3333333333333333ULL, m4 = 0x0F0F0F0F0F0F0F0FULL;
+	int words = (width + 15) / 16;
+	for(int i = 0; i < words; i++) {
+		quint64 hi = 0, lo = 0;
+		for(int k = 0; k < 4; k++) {
+			quint64 v;
+			memcpy(&v, band.constScanLine(row*4 + k) + i*8, 8);
+			if(invert) {v = ~v;}
+			v = v - ((v >> 1) & m1);
+			v = (v & m2) + ((v >> 2) & m2);
+			//Every nibble holds its count (0..4), the bytes can hold the sum of the 4 rows
+			hi += (v >> 4) & m4;
+			lo += v & m4;
+		}
+
+		//Back to the memory order: the high nibble of a byte is the left pixel
+		uchar h[8], l[8];
+		memcpy(h, &hi, 8);
+		memcpy(l, &lo, 8);
+		for(int j = 0; j < 8; j++) {
+			int x = i*16 + j*2;
+			if(x < width) {sums[x] = h[j];}
+			if(x + 1 < width) {sums[x + 1] = l[j];}
+		}
+	}
+}
+
+//Composites the foreground color with the coverage (0..255) over a row of the device
+static void compositeRow(uchar* line, QImage::Format format, int width, const std::vector<int>& alpha, const QColor& color) {
+	switch(format) {
+		case QImage::Format_Alpha8:
+			for(int x = 0; x < width; x++) {
+				int a = alpha[x] * color.alpha() / 255;
+				line[x] = uchar(line[x] + ((255 - line[x]) * a + 127) / 255);
+			}
+			break;
+		case QImage::Format_Grayscale8: {
+			int g = qGray(color.rgb());
+			for(int x = 0; x < width; x++) {
+				int a = alpha[x] * color.alpha() / 255;
+				line[x] = uchar((line[x] * (255 - a) + g * a + 127) / 255);
+			}
+		}
+		break;
+		default: {
+			//The 32bpp formats: SourceOver of the premultiplied color
+			quint32* px = reinterpret_cast<quint32*>(line);
+			QRgb c = color.rgba();
+			bool premultiplied = (format == QImage::Format_ARGB32_Premultiplied);
+			bool opaque = (format == QImage::Format_RGB32);
+			for(int x = 0; x < width; x++) {
+				int a = alpha[x] * qAlpha(c) / 255;
+				if(a == 0) {continue;}
+				QRgb d = px[x];
+				if(opaque) {d |= 0xFF000000u;}
+				else if(!premultiplied) {d = qPremultiply(d);}
+				int ia = 255 - a;
+				QRgb r = qRgba(	(qRed(c) * a + qRed(d) * ia + 127) / 255,
+						(qGreen(c) * a + qGreen(d) * ia + 127) / 255,
+						(qBlue(c) * a + qBlue(d) * ia + 127) / 255,
+						a + (qAlpha(d) * ia + 127) / 255);
+				if(!premultiplied && !opaque) {r = qUnpremultiply(r);}
+				px[x] = r;
+			}
+		}
+		break;
+	}
+}
+
+bool gerbvQt::renderSupersampled(	QPaintDevice * device,
+					const gerbv_image_t* gImage,
+					gerbvQtNetSource& nets,
+					const gerbv_user_transformation_t& utransform,
+					const gerbv_render_info_t* renderInfo) {
+
+	if(ssFactor < 2 || device->devType() != QInternal::Image) {return false;}
+	QImage* target = static_cast<QImage*>(device);
+	switch(target->format()) {
+		case QImage::Format_Alpha8:
+		case QImage::Format_Grayscale8:
+		case QImage::Format_RGB32:
+		case QImage::Format_ARGB32:
+		case QImage::Format_ARGB32_Premultiplied:
+			break;
+		default:
+			return false;
+	}
+	int n = ssFactor;
+
+	//The coverage itself in dm_AlphaMask mode
+	QColor coverColor = (dM == dm_AlphaMask) ? QColor(Qt::white) : fgColor;
+
+	drawingModeType savedMode = dM;
+	QColor savedFg = fgColor;
+	QColor savedBg = bgColor;
+	QPainter::RenderHints savedHints = rhints;
+	QPoint savedOrigin = origin;
+	ssFactor = 0;
+	rhints &= ~QPainter::Antialiasing;
+
+	//The nets are drawn into the 1bpp bands of the full picture at n x n the resolution: plan for them once
+	int width = target->width();
+	int height = target->height();
+	gerbv_render_info_t hiInfo = *renderInfo;
+	hiInfo.scaleFactorX *= n;
+	hiInfo.scaleFactorY *= n;
+	hiInfo.displayWidth *= n;
+	hiInfo.displayHeight *= n;
+	dM = dm_TwoColors;
+	origin = QPoint(savedOrigin.x() * n, savedOrigin.y() * n);
+	autoPlan(QSize(width*n, height*n), QImage::Format_Mono, gImage, nets, utransform, &hiInfo);
+	dM = savedMode;
+	origin = savedOrigin;
+
+	//1. The initial fill: the background, whatever the image polarity is. The dark areas
+	//(including the dark fill of the negative images) come with the coverage.
+	if(startFill) {
+		gerbv_user_transformation_t bgTransform = utransform;
+		bgTransform.inverted = (gImage->info->polarity == GERBV_POLARITY_NEGATIVE);
+		gerbvQtNoNets noNets;
+		renderNets(device, gImage, noNets, bgTransform, renderInfo);
+	}
+
+	//2. The coverage, band by band
+	dM = dm_TwoColors;
+	fgColor = Qt::black;
+	bgColor = Qt::white;
+
+	//The band is wider than needed, so countBlocks can read past the last group
+	QImage band(width*n + 64, 1, QImage::Format_Mono);
+	int bandRows = qBound(1, int(GERBVQT_COVERAGE_BAND_BYTES / (qint64(band.bytesPerLine()) * n)), qMax(1, height));
+	band = QImage(width*n + 64, bandRows*n, QImage::Format_Mono);
+	band.setColor(0, qRgb(255, 255, 255));
+	band.setColor(1, qRgb(0, 0, 0));
+
+	//Which index QPainter uses for black
+	QImage probe(1, 1, QImage::Format_Mono);
+	probe.setColorTable(band.colorTable());
+	probe.fill(0);
+	QPainter probePainter(&probe);
+	probePainter.fillRect(0, 0, 1, 1, QColor(Qt::black));
+	probePainter.end();
+	uint darkIndex = probe.pixelIndex(0, 0);
+
+	//Not scanLine in the threads, it may detach the image
+	uchar* bits = target->bits();
+	int bytesPerLine = target->bytesPerLine();
+	QImage::Format format = target->format();
+
+	for(int y0 = 0; y0 < height; y0 += bandRows) {
+		int rows = qMin(bandRows, height - y0);
+		band.fill(1 - darkIndex);
+		origin = QPoint(savedOrigin.x() * n, (savedOrigin.y() + y0) * n);
+		renderNets(&band, gImage, nets, utransform, &hiInfo);
+
+		//The filtering and compositing run in parallel, row by row
+		parallelFor(rows, [&](int from, int to) {
+			std::vector<int> sums(width + 16);
+			for(int r = from; r < to; r++) {
+				if(n == 4) {countBlocks4(band, r, width, darkIndex == 0, sums);}
+				else {countBlocks(band, r, n, width, darkIndex == 0, sums);}
+				for(int x = 0; x < width; x++) {sums[x] = (sums[x] * 255 + n*n/2) / (n*n);}
+				compositeRow(bits + qint64(y0 + r) * bytesPerLine, format, width, sums, coverColor);
+			}
+		});
+	}
+
+	dM = savedMode;
+	fgColor = savedFg;
+	bgColor = savedBg;
+	rhints = savedHints;
+	origin = savedOrigin;
+	ssFactor = n;
+	return true;
+}
+
+bool gerbvQt::compositeMask(QImage& dst, const QImage& mask, const QColor& color, const QPoint& pos) {
+	if(mask.format() != QImage::Format_Alpha8 && mask.format() != QImage::Format_Grayscale8) {return false;}
+	switch(dst.format()) {
+		case QImage::Format_Alpha8:
+		case QImage::Format_Grayscale8:
+		case QImage::Format_RGB32:
+		case QImage::Format_ARGB32:
+		case QImage::Format_ARGB32_Premultiplied:
+			break;
+		default:
+			return false;
+	}
+	QRect box = QRect(pos, mask.size()).intersected(dst.rect());
+	if(box.isEmpty() || color.alpha() == 0) {return true;}
+
+	//Not scanLine in the threads, it may detach the image
+	uchar* bits = dst.bits();
+	int bytesPerLine = dst.bytesPerLine();
+	int bytesPerPixel = dst.depth() / 8;
+	QImage::Format format = dst.format();
+	parallelFor(box.height(), [&](int from, int to) {
+		std::vector<int> alpha(box.width());
+		for(int r = from; r < to; r++) {
+			int y = box.top() + r;
+			const uchar* m = mask.constScanLine(y - pos.y()) + (box.left() - pos.x());
+			bool empty = true;
+			for(int x = 0; x < box.width(); x++) {
+				alpha[x] = m[x];
+				if(m[x] != 0) {empty = false;}
+			}
+			if(empty) {continue;}
+			compositeRow(bits + qint64(y) * bytesPerLine + box.left() * bytesPerPixel, format, box.width(), alpha, color);
+		}
+	});
+	return true;
+}